@@ -0,0 +1,371 @@
+// Headless benchmark: runs update_physics as fast as it can with no display, font or timer,
+// so it works on machines without a screen and measures the physics on its own.
+//
+// ./bench.out --circles 20000 --min-radius 2 --max-radius 4 --width 1920 --height 1080 --steps 500 --seed 7
+
+// standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// lib
+#include "lib/simulation/simulation.h"
+#include "lib/profiler/profiler.h"
+
+// prototypes
+void print_usage(const char* program);
+void print_broad_phase(BroadPhase* broad_phase, Simulation* sim);
+void print_counters(Profiler* profiler, double circle_steps, int64_t contacts);
+double seconds_now(void);
+
+int main(int argc, char** argv)
+{
+    SimulationSettings settings;
+    settings.circle_count = 10000;
+    settings.circle_min_radius = 2;
+    settings.circle_max_radius = 4;
+    settings.circle_max_speed = 5;
+    settings.thread_count = 1;
+    settings.world_width = 1920;
+    settings.world_height = 1080;
+    settings.cell_size = 0;
+    settings.broad_phase = BROAD_PHASE_GRID;
+    settings.neighbour_skin = 0.0f;
+    settings.seed = 1;
+    settings.packing_fraction = 0.0f;
+    settings.reorder_threshold = 0.0f;
+    settings.incremental_grid = false;
+    settings.restitution = 1.0f;
+    settings.damping = 0.0f;
+    settings.sleep_speed = 0.0f;
+    int steps = 1000;
+    const char* profile_path = NULL;
+    bool counters = false;
+
+    static struct option options[] = {
+        {"circles", required_argument, NULL, 'n'},
+        {"min-radius", required_argument, NULL, 'r'},
+        {"max-radius", required_argument, NULL, 'R'},
+        {"max-speed", required_argument, NULL, 'v'},
+        {"width", required_argument, NULL, 'w'},
+        {"height", required_argument, NULL, 'h'},
+        {"seed", required_argument, NULL, 's'},
+        {"steps", required_argument, NULL, 'i'},
+        {"threads", required_argument, NULL, 't'},
+        {"cell-size", required_argument, NULL, 'c'},
+        {"profile", required_argument, NULL, 'p'},
+        {"broad-phase", required_argument, NULL, 'b'},
+        {"skin", required_argument, NULL, 'k'},
+        {"packing", required_argument, NULL, 'f'},
+        {"counters", no_argument, NULL, 'C'},
+        {"reorder", required_argument, NULL, 'o'},
+        {"incremental", no_argument, NULL, 'I'},
+        {"restitution", required_argument, NULL, 'e'},
+        {"damping", required_argument, NULL, 'd'},
+        {"sleep", required_argument, NULL, 'z'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:r:R:v:w:h:s:i:t:c:p:b:k:f:Co:Ie:d:z:", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': settings.circle_count = atoi(optarg); break;
+        case 'r': settings.circle_min_radius = atoi(optarg); break;
+        case 'R': settings.circle_max_radius = atoi(optarg); break;
+        case 'v': settings.circle_max_speed = atoi(optarg); break;
+        case 'w': settings.world_width = atoi(optarg); break;
+        case 'h': settings.world_height = atoi(optarg); break;
+        case 's': settings.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'i': steps = atoi(optarg); break;
+        case 't': settings.thread_count = atoi(optarg); break;
+        case 'c': settings.cell_size = atoi(optarg); break;
+        case 'p': profile_path = optarg; break;
+        case 'k': settings.neighbour_skin = atof(optarg); break;
+        case 'f': settings.packing_fraction = atof(optarg); break;
+        case 'C': counters = true; break;
+        case 'o': settings.reorder_threshold = atof(optarg); break;
+        case 'I': settings.incremental_grid = true; break;
+        case 'e': settings.restitution = atof(optarg); break;
+        case 'd': settings.damping = atof(optarg); break;
+        case 'z': settings.sleep_speed = atof(optarg); break;
+        case 'b':
+            settings.broad_phase = BROAD_PHASE_TYPE_COUNT;
+            for (int type = 0; type < BROAD_PHASE_TYPE_COUNT; type++)
+            {
+                if (strcmp(optarg, broad_phase_names[type]) == 0)
+                    settings.broad_phase = type;
+            }
+            if (settings.broad_phase == BROAD_PHASE_TYPE_COUNT)
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // circle_place needs a speed range and the placement needs a margin of 50 on each side
+    if ((settings.circle_count < 1 && settings.packing_fraction <= 0.0f) || steps < 1 || settings.circle_max_speed < 2 ||
+        settings.circle_min_radius < 1 || settings.circle_max_radius < settings.circle_min_radius ||
+        settings.world_width <= 100 || settings.world_height <= 100)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (settings.packing_fraction > 0.0f)
+        printf("packing %.2f, ", settings.packing_fraction);
+    else
+        printf("circles %d, ", settings.circle_count);
+    printf("radius %d-%d, world %dx%d, seed %u, threads %d, steps %d\n",
+           settings.circle_min_radius, settings.circle_max_radius,
+           settings.world_width, settings.world_height, settings.seed, settings.thread_count, steps);
+    fflush(stdout);
+
+    double setup_start = seconds_now();
+    Simulation* sim = simulation_create(settings);
+    double setup_time = seconds_now() - setup_start;
+
+    if (!sim->placement.complete)
+    {
+        fprintf(stderr, "couldn't place every circle: %d placed, %d found no room, %.1f%% of the world covered\n",
+                sim->placement.placed, sim->placement.failed, sim->placement.packing * 100.0f);
+        simulation_destroy(sim);
+        return 1;
+    }
+
+    // profiling is opt-in, so the plain numbers aren't skewed by the timer calls.
+    // the counters need the profiler too, but not the CSV. this thread runs the steps, so it's the one counted.
+    Profiler* profiler = NULL;
+    if (profile_path || counters)
+    {
+        profiler = profiler_create(profile_path, counters);
+        if (!profiler)
+        {
+            fprintf(stderr, "couldn't open %s\n", profile_path);
+            return 1;
+        }
+        simulation_set_profiler(sim, profiler);
+    }
+
+    int64_t contacts = 0;
+    double start = seconds_now();
+    for (int step = 0; step < steps; step++)
+    {
+        update_physics(sim);
+        profiler_end_frame(profiler);
+        contacts += sim->last_stats.contacts;
+    }
+    double elapsed = seconds_now() - start;
+
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    double circle_steps = (double)steps * settings.circle_count;
+    printf("setup           %10.3f s (%d circles, %.1f%% of the world covered)\n", setup_time, sim->circles->count, sim->placement.packing * 100.0f);
+    printf("physics         %10.3f s\n", elapsed);
+    printf("steps/sec       %10.1f\n", steps / elapsed);
+    printf("ns/circle-step  %10.2f\n", elapsed * 1e9 / circle_steps);
+    printf("peak memory     %10.1f MiB\n", usage.ru_maxrss / 1024.0);
+    print_broad_phase(sim->broad_phase, sim);
+    if (sim->order)
+        printf("reorders        %10lld in %lld checks, %.1f%% scattered at the last one\n", (long long)sim->order->reorders,
+               (long long)sim->order->checks, sim->order->scatter * 100.0f);
+    if (sim->sleep)
+        printf("asleep          %10d circles after the last step, %lld islands put to sleep in %lld checks\n", sim->sleep->asleep,
+               (long long)sim->sleep->islands, (long long)sim->sleep->checks);
+
+    if (counters)
+        print_counters(profiler, circle_steps, contacts);
+
+    if (profile_path)
+    {
+        ProfileFrame average = profiler_average(profiler, PROFILER_HISTORY);
+        printf("last %d steps, average per step:\n", PROFILER_HISTORY);
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
+            printf("  %-18s %10.3f ms\n", profiler_phase_names[phase], average.phase_ns[phase] / 1e6);
+        printf("  pairs tested       %10lld\n", (long long)average.candidate_pairs);
+        printf("  contacts           %10lld\n", (long long)average.contacts);
+        printf("  occupied cells     %10d\n", average.occupied_cells);
+        printf("  max per cell       %10d\n", average.max_cell_occupancy);
+        if (broad_phase_current(sim->broad_phase)->nlist)
+        {
+            printf("  list pairs         %10d\n", average.neighbour_pairs);
+            printf("  list rebuilds      %10d (in %d steps)\n", average.neighbour_rebuilds, PROFILER_HISTORY);
+        }
+    }
+    profiler_destroy(profiler);
+
+    simulation_destroy(sim);
+    return 0;
+}
+
+void print_usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n, --circles N      number of circles (10000)\n"
+            "  -r, --min-radius R   smallest radius (2)\n"
+            "  -R, --max-radius R   largest radius (4)\n"
+            "  -v, --max-speed V    largest starting speed, at least 2 (5)\n"
+            "  -w, --width W        world width, more than 100 (1920)\n"
+            "  -h, --height H       world height, more than 100 (1080)\n"
+            "  -s, --seed S         random seed (1)\n"
+            "  -i, --steps N        physics steps to run (1000)\n"
+            "  -t, --threads N      collision threads (1)\n"
+            "  -c, --cell-size N    grid cell size in pixels, 0 picks one automatically (0)\n"
+            "  -p, --profile FILE   write per-step phase timings to a CSV\n"
+            "  -b, --broad-phase B  grid, hgrid (hierarchical grid, for a wide spread of radii),\n"
+            "                       sap (sweep and prune), quadtree (loose quadtree, for clustered scenes),\n"
+            "                       hash (hashed grid, for huge sparse worlds)\n"
+            "                       or auto (tries each for a few steps and keeps the fastest) (grid)\n"
+            "  -k, --skin S         cache pairs within S pixels of touching, only with the grid, 0 is off (0)\n"
+            "  -f, --packing F      place circles until they cover this fraction of the world, instead of --circles (0)\n"
+            "  -o, --reorder F      sort the circles by position whenever more than this fraction (0 to 1) is far from\n"
+            "                       its neighbour in memory, checked every %d steps. 0 is off (0)\n"
+            "  -I, --incremental    keep the grid between steps and only move circles that changed cell, only with the grid\n"
+            "  -e, --restitution E  speed kept when two circles bounce, 1 keeps all of it (1)\n"
+            "  -d, --damping D      fraction of its speed every circle loses each step (0)\n"
+            "  -z, --sleep S        put circles to sleep once they and everything touching them are slower than S\n"
+            "                       pixels per step for %d steps, 0 is off (0). needs --damping to settle\n"
+            "  -C, --counters       count cycles, instructions, cache and branch misses in each phase (Linux only).\n"
+            "                       only this thread is counted, so leave --threads at 1 for the whole picture\n",
+            program, SPATIAL_ORDER_CHECK_STEPS, SLEEP_STILL_STEPS);
+}
+
+void print_broad_phase(BroadPhase* broad_phase, Simulation* sim)
+{
+    if (broad_phase->type == BROAD_PHASE_AUTO)
+    {
+        BroadPhase* chosen = broad_phase_current(broad_phase);
+        // a run shorter than all the trials stops partway through them, and whatever's active then wasn't chosen
+        int trials_run = broad_phase->trial_done ? BROAD_PHASE_AUTO : broad_phase->trial_step / BROAD_PHASE_TRIAL_STEPS;
+        printf("broad phase     %10s (auto, %d timed steps each)\n",
+               broad_phase->trial_done ? broad_phase_names[chosen->type] : "undecided", BROAD_PHASE_TRIAL_STEPS - 1);
+        for (int type = 0; type < BROAD_PHASE_AUTO; type++)
+        {
+            if (type >= trials_run)
+            {
+                printf("  %-12s  %10s\n", broad_phase_names[type], "not tried");
+                continue;
+            }
+            printf("  %-12s  %10.3f ms/step, %lld pairs/step\n", broad_phase_names[type],
+                   broad_phase->trial_ns[type] / 1e6 / (BROAD_PHASE_TRIAL_STEPS - 1),
+                   (long long)(broad_phase->trial_pairs[type] / (BROAD_PHASE_TRIAL_STEPS - 1)));
+        }
+        broad_phase = chosen;
+    }
+    else
+        printf("broad phase     %10s\n", broad_phase_names[broad_phase->type]);
+
+    if (broad_phase->hgrid)
+    {
+        HierarchicalGrid* hgrid = broad_phase->hgrid;
+        printf("grid levels     %10d (cells %d to %d)\n", hgrid->level_count, hgrid->base_cell_size,
+               hgrid->base_cell_size << (hgrid->level_count - 1));
+        for (int level = 0; level < hgrid->level_count; level++)
+            printf("  level %-2d       %10d circles in %d cells\n", level, hgrid->level_population[level],
+                   hgrid->levels[level]->rows * hgrid->levels[level]->columns);
+        printf("pairs/step      %10lld measured on the last step\n", (long long)sim->last_stats.candidate_pairs);
+    }
+    else if (broad_phase->sap)
+    {
+        printf("sap swaps       %10lld on the last step\n", (long long)broad_phase->sap->swaps);
+        printf("pairs/step      %10lld measured on the last step\n", (long long)sim->last_stats.candidate_pairs);
+    }
+    else if (broad_phase->hashed_grid)
+    {
+        printf("cell size       %10d (reach %d, %s)\n", broad_phase->grid_choice.cell_size, broad_phase->grid_choice.reach,
+               sim->settings.cell_size > 0 ? "fixed" : "auto");
+        printf("table slots     %10d, %d cells in use\n", broad_phase->hashed_grid->capacity, broad_phase->hashed_grid->used_count);
+        printf("pairs/step      %10lld measured on the last step\n", (long long)sim->last_stats.candidate_pairs);
+    }
+    else if (broad_phase->quadtree)
+    {
+        printf("quadtree nodes  %10d (max depth %d)\n", broad_phase->quadtree->node_count, broad_phase->quadtree->max_depth);
+        printf("pairs/step      %10lld measured on the last step\n", (long long)sim->last_stats.candidate_pairs);
+    }
+    else
+    {
+        printf("cell size       %10d (reach %d, %s)\n", broad_phase->grid_choice.cell_size, broad_phase->grid_choice.reach,
+               sim->settings.cell_size > 0 ? "fixed" : "auto");
+        printf("pairs/step      %10.0f estimated, %lld measured on the last step\n",
+               broad_phase->grid_choice.estimated_pairs, (long long)sim->last_stats.candidate_pairs);
+        if (broad_phase->settings.incremental_grid)
+            printf("incremental     %10d circles changed cell on the last step, %lld full layouts\n",
+                   broad_phase->grid->relinked, (long long)broad_phase->grid->incremental_builds);
+    }
+
+    NeighbourList* nlist = broad_phase->nlist;
+    if (nlist)
+    {
+        printf("neighbour list  %10lld builds in %lld steps (every %.1f steps), skin %.1f\n",
+               (long long)nlist->builds, (long long)nlist->steps, (double)nlist->steps / nlist->builds, nlist->skin);
+        printf("list pairs      %10d\n", nlist->pair_count);
+    }
+}
+
+// Whole-run totals for each phase, divided by circle-steps (and misses per contact, which is what a better layout should bring down).
+void print_counters(Profiler* profiler, double circle_steps, int64_t contacts)
+{
+    if (!profiler->counters)
+    {
+        printf("hardware counters unavailable (not Linux, no PMU, or /proc/sys/kernel/perf_event_paranoid is above 2)\n");
+        return;
+    }
+
+    bool* available = profiler->counters->available;
+    printf("hardware counters, whole run, per circle-step:\n");
+    printf("  %-18s", "");
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        printf(" %13s", perf_counter_names[counter]);
+    printf(" %6s\n", "ipc");
+
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
+    {
+        int64_t* totals = profiler->counter_totals[phase];
+        if (phase == PROFILE_RENDER || totals[PERF_CYCLES] + totals[PERF_INSTRUCTIONS] == 0)
+            continue; // nothing ran in it (e.g. the move is folded into the grid build)
+
+        printf("  %-18s", profiler_phase_names[phase]);
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        {
+            if (available[counter])
+                printf(" %13.3f", totals[counter] / circle_steps);
+            else
+                printf(" %13s", "-");
+        }
+        if (available[PERF_CYCLES] && available[PERF_INSTRUCTIONS] && totals[PERF_CYCLES] > 0)
+            printf(" %6.2f\n", (double)totals[PERF_INSTRUCTIONS] / totals[PERF_CYCLES]);
+        else
+            printf(" %6s\n", "-");
+    }
+
+    int64_t* collisions = profiler->counter_totals[PROFILE_CIRCLE_COLLISIONS];
+    if (contacts > 0 && (available[PERF_L1D_MISSES] || available[PERF_LLC_MISSES]))
+    {
+        printf("  circle_collisions misses per contact:");
+        if (available[PERF_L1D_MISSES])
+            printf(" l1d %.2f", (double)collisions[PERF_L1D_MISSES] / contacts);
+        if (available[PERF_LLC_MISSES])
+            printf(" llc %.2f", (double)collisions[PERF_LLC_MISSES] / contacts);
+        printf("\n");
+    }
+}
+
+double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
@@ -1,9 +1,40 @@
 #!/usr/bin/env bash
-gcc -g -O0 -o main.out main.c \
-window_settings.c \
-lib/collision/circle_collider/circle_collider.c \
+# ./build.sh        builds the windowed app, main.out
+# ./build.sh bench  builds the headless benchmark, bench.out (no display needed, see bench.c)
+# ./build.sh scenarios  builds the scenario suite and its brute-force check, scenarios.out (see scenarios.c)
+
+LIB_SOURCES="lib/collision/circle_collider/circle_collider.c \
 lib/collision/window_bounds_collider/window_bounds_collider.c \
-lib/spatial_grid/spatial_grid.c \
+lib/spatial_grid/spatial_grid.c lib/hierarchical_grid/hierarchical_grid.c \
+lib/neighbour_list/neighbour_list.c \
+lib/sweep_and_prune/sweep_and_prune.c \
+lib/loose_quadtree/loose_quadtree.c \
+lib/hashed_grid/hashed_grid.c \
+lib/broad_phase/broad_phase.c \
+lib/placement/placement.c \
+lib/simulation/simulation.c \
 lib/window/window.c \
 lib/circle/circle.c \
-$(pkg-config --cflags --libs allegro-5 allegro_primitives-5 allegro_font-5 allegro_ttf-5) -lm
+lib/random/random.c \
+lib/thread_pool/thread_pool.c \
+lib/profiler/profiler.c \
+lib/perf_counters/perf_counters.c \
+lib/spatial_order/spatial_order.c \
+lib/sleep/sleep.c"
+
+if [ "$1" == "bench" ]; then
+gcc -O2 -march=native -o bench.out bench.c \
+$LIB_SOURCES \
+$(pkg-config --cflags --libs allegro-5 allegro_primitives-5) -lm -pthread
+elif [ "$1" == "scenarios" ]; then
+gcc -O2 -march=native -o scenarios.out scenarios.c \
+$LIB_SOURCES \
+$(pkg-config --cflags --libs allegro-5 allegro_primitives-5) -lm -pthread
+else
+gcc -g -O0 -march=native -o main.out main.c \
+window_settings.c \
+lib/circle_batch/circle_batch.c \
+lib/render_state/render_state.c \
+$LIB_SOURCES \
+$(pkg-config --cflags --libs allegro-5 allegro_primitives-5 allegro_font-5 allegro_ttf-5) -lm -pthread
+fi
@@ -0,0 +1,438 @@
+#include "broad_phase.h"
+#include "../profiler/profiler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// private prototypes
+void grid_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void grid_backend_build(BroadPhase* broad_phase, CircleStore* circles);
+bool grid_backend_move_and_build(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool);
+void grid_backend_move_chunk(void* context, int begin, int end);
+void grid_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void grid_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+void hgrid_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void hgrid_backend_build(BroadPhase* broad_phase, CircleStore* circles);
+void hgrid_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void hgrid_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+void sap_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void sap_backend_build(BroadPhase* broad_phase, CircleStore* circles);
+void sap_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void quadtree_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void quadtree_backend_build(BroadPhase* broad_phase, CircleStore* circles);
+void quadtree_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void quadtree_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+void hashed_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void hashed_backend_build(BroadPhase* broad_phase, CircleStore* circles);
+void hashed_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void hashed_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+void auto_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void auto_backend_build(BroadPhase* broad_phase, CircleStore* circles);
+void auto_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void auto_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+void no_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+
+const char* broad_phase_names[BROAD_PHASE_TYPE_COUNT] = {
+    "grid",
+    "hgrid",
+    "sap",
+    "quadtree",
+    "hash",
+    "auto",
+};
+
+static const BroadPhaseBackend backends[BROAD_PHASE_TYPE_COUNT] = {
+    {grid_backend_fit, grid_backend_build, grid_backend_move_and_build, grid_backend_collide, grid_backend_get_occupancy},
+    {hgrid_backend_fit, hgrid_backend_build, NULL, hgrid_backend_collide, hgrid_backend_get_occupancy},
+    {sap_backend_fit, sap_backend_build, NULL, sap_backend_collide, no_occupancy},
+    {quadtree_backend_fit, quadtree_backend_build, NULL, quadtree_backend_collide, quadtree_backend_get_occupancy},
+    {hashed_backend_fit, hashed_backend_build, NULL, hashed_backend_collide, hashed_backend_get_occupancy},
+    // auto has to see every build to time its trials, so it always goes the long way round
+    {auto_backend_fit, auto_backend_build, NULL, auto_backend_collide, auto_backend_get_occupancy},
+};
+
+BroadPhase* broad_phase_create(BroadPhaseType type, BroadPhaseSettings settings, CircleStore* circles, int world_w, int world_h)
+{
+    BroadPhase* broad_phase = malloc(sizeof(BroadPhase));
+    memset(broad_phase, 0, sizeof(BroadPhase));
+    broad_phase->type = type;
+    broad_phase->backend = &backends[type];
+    broad_phase->settings = settings;
+
+    switch (type)
+    {
+    case BROAD_PHASE_GRID:
+        // the grid itself waits for grid_backend_fit, which knows what cell size to make it at
+        if (settings.neighbour_skin > 0.0f)
+            broad_phase->nlist = nlist_create(settings.neighbour_skin);
+        break;
+    case BROAD_PHASE_HIERARCHICAL_GRID:
+        broad_phase->hgrid = hgrid_create(circles->radius, circles->count, world_w, world_h);
+        break;
+    case BROAD_PHASE_SWEEP_AND_PRUNE:
+        broad_phase->sap = sap_create(circles->count);
+        break;
+    case BROAD_PHASE_LOOSE_QUADTREE:
+        broad_phase->quadtree = quadtree_create(circles, world_w, world_h);
+        break;
+    case BROAD_PHASE_HASHED_GRID:
+        broad_phase->hashed_grid = hashed_grid_create(circles->count, 1, 1);
+        break;
+    default:
+        // auto starts on the first backend, auto_backend_build moves it along
+        broad_phase->active = broad_phase_create(0, settings, circles, world_w, world_h);
+        break;
+    }
+
+    broad_phase_fit(broad_phase, circles, world_w, world_h);
+    return broad_phase;
+}
+
+void broad_phase_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    broad_phase->world_width = world_w;
+    broad_phase->world_height = world_h;
+    broad_phase->backend->fit(broad_phase, circles, world_w, world_h);
+}
+
+void broad_phase_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    broad_phase->backend->build(broad_phase, circles);
+}
+
+bool broad_phase_move_and_build(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool)
+{
+    if (!broad_phase->backend->move_and_build)
+        return false;
+    return broad_phase->backend->move_and_build(broad_phase, circles, pool);
+}
+
+void broad_phase_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    if (broad_phase->pair_log)
+        ccoll_pair_log_begin(broad_phase->pair_log, circles);
+    broad_phase->backend->collide(broad_phase, circles, pool, stats);
+}
+
+void broad_phase_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    broad_phase->backend->get_occupancy(broad_phase, occupied, max_occupancy);
+}
+
+void broad_phase_set_pair_log(BroadPhase* broad_phase, CollisionPairLog* log)
+{
+    broad_phase->pair_log = log;
+}
+
+void broad_phase_set_contact_log(BroadPhase* broad_phase, CollisionPairLog* log)
+{
+    broad_phase->contact_log = log;
+}
+
+BroadPhase* broad_phase_current(BroadPhase* broad_phase)
+{
+    return broad_phase->active ? broad_phase->active : broad_phase;
+}
+
+void broad_phase_destroy(BroadPhase* broad_phase)
+{
+    if (broad_phase)
+    {
+        grid_destroy(broad_phase->grid);
+        nlist_destroy(broad_phase->nlist);
+        hgrid_destroy(broad_phase->hgrid);
+        sap_destroy(broad_phase->sap);
+        quadtree_destroy(broad_phase->quadtree);
+        hashed_grid_destroy(broad_phase->hashed_grid);
+        broad_phase_destroy(broad_phase->active);
+        free(broad_phase);
+    }
+}
+
+// --- uniform grid, with an optional neighbour list on top ---
+
+void grid_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    // a neighbour list needs the grid to find pairs that are up to a skin apart, not just touching
+    float margin = broad_phase->nlist ? broad_phase->nlist->skin : 0.0f;
+
+    broad_phase->grid_choice = grid_choose_cell_size(circles->radius, circles->count, world_w, world_h, broad_phase->settings.cell_size, margin);
+    int cell_size = broad_phase->grid_choice.cell_size;
+    if (!broad_phase->grid)
+        broad_phase->grid = grid_create(circles->count, world_w, world_h, cell_size, cell_size, broad_phase->grid_choice.reach);
+    else
+        grid_resize(broad_phase->grid, world_w, world_h, cell_size, cell_size, broad_phase->grid_choice.reach);
+
+    // the grid was just emptied, so the list can't be rebuilt from it until everything is inserted again
+    if (broad_phase->nlist)
+        nlist_invalidate(broad_phase->nlist);
+}
+
+void grid_backend_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    SpatialGrid* grid = broad_phase->grid;
+
+    // nothing can have closed a gap wider than the skin yet, so last build's pairs still cover every contact
+    if (broad_phase->nlist && !nlist_needs_rebuild(broad_phase->nlist, circles))
+        return;
+
+    if (broad_phase->settings.incremental_grid)
+    {
+        // circles added, removed or reordered since the layout was made have different indexes, so start over
+        if (!grid->incremental || broad_phase->grid_layout_version != circles->layout_version ||
+            grid_update_incremental(grid, circles->x, circles->y, circles->count) < 0)
+        {
+            grid_build_incremental(grid, circles->x, circles->y, circles->count);
+            broad_phase->grid_layout_version = circles->layout_version;
+        }
+    }
+    else
+        grid_build(grid, circles->x, circles->y, circles->count, NULL, NULL, NULL);
+
+    if (broad_phase->nlist)
+        nlist_build(broad_phase->nlist, grid, circles);
+}
+
+bool grid_backend_move_and_build(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool)
+{
+    // the neighbour list has to see the circles after they've moved to know whether to rebuild at all
+    if (broad_phase->nlist)
+        return false;
+    // the incremental grid is kept rather than rebuilt, so there's no pass over the circles to fold the move into
+    if (broad_phase->settings.incremental_grid)
+        return false;
+
+    grid_build(broad_phase->grid, circles->x, circles->y, circles->count, pool, grid_backend_move_chunk, circles);
+    return true;
+}
+
+void grid_backend_move_chunk(void* context, int begin, int end)
+{
+    CircleStore* circles = context;
+    circle_remember_positions_range(circles, begin, end);
+    circle_move_range(circles, begin, end);
+}
+
+void grid_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    if (broad_phase->nlist)
+        ccoll_rebound_velocity_pairs(broad_phase->nlist, circles, stats, broad_phase->pair_log, broad_phase->contact_log);
+    else
+        ccoll_rebound_velocity(broad_phase->grid, circles, pool, stats, broad_phase->pair_log, broad_phase->contact_log);
+}
+
+void grid_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    grid_get_occupancy(broad_phase->grid, occupied, max_occupancy);
+}
+
+// --- hierarchical grid ---
+
+void hgrid_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    hgrid_fit(broad_phase->hgrid, circles->radius, circles->count, world_w, world_h);
+}
+
+void hgrid_backend_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    // each level gets sorted by the collider as it gets to it
+    hgrid_clear(broad_phase->hgrid);
+    for (int i = 0; i < circles->count; i++)
+        hgrid_insert(broad_phase->hgrid, i, circles->x[i], circles->y[i], circles->radius[i]);
+}
+
+void hgrid_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    (void)pool;
+    ccoll_rebound_velocity_hierarchical(broad_phase->hgrid, circles, stats, broad_phase->pair_log, broad_phase->contact_log);
+}
+
+void hgrid_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    hgrid_get_occupancy(broad_phase->hgrid, occupied, max_occupancy);
+}
+
+// --- sweep and prune ---
+
+void sap_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    // no cells, nothing depends on the world size
+    (void)broad_phase;
+    (void)circles;
+    (void)world_w;
+    (void)world_h;
+}
+
+void sap_backend_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    // keeps last step's order and fixes it up
+    sap_update(broad_phase->sap, circles);
+}
+
+void sap_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    (void)pool;
+    ccoll_rebound_velocity_sweep(broad_phase->sap, circles, stats, broad_phase->pair_log, broad_phase->contact_log);
+}
+
+// --- loose quadtree ---
+
+void quadtree_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    quadtree_fit(broad_phase->quadtree, circles, world_w, world_h);
+}
+
+void quadtree_backend_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    quadtree_clear(broad_phase->quadtree);
+    for (int i = 0; i < circles->count; i++)
+        quadtree_insert(broad_phase->quadtree, circles, i);
+}
+
+void quadtree_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    (void)pool;
+    ccoll_rebound_velocity_quadtree(broad_phase->quadtree, circles, stats, broad_phase->pair_log, broad_phase->contact_log);
+}
+
+void quadtree_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    quadtree_get_occupancy(broad_phase->quadtree, occupied, max_occupancy);
+}
+
+// --- hashed grid ---
+
+void hashed_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    // no edges, so the world size doesn't matter
+    (void)world_w;
+    (void)world_h;
+
+    float max_radius = 1.0f;
+    for (int i = 0; i < circles->count; i++)
+    {
+        if (circles->radius[i] > max_radius)
+            max_radius = circles->radius[i];
+    }
+
+    // empty cells cost nothing here, so there's no reason to go bigger than a 3x3 search around the biggest circle needs.
+    // a fixed cell size smaller than that gets a wider search instead.
+    int diameter = (int)ceilf(max_radius * 2.0f);
+    int cell_size = broad_phase->settings.cell_size > 0 ? broad_phase->settings.cell_size : diameter;
+    int reach = (diameter + cell_size - 1) / cell_size;
+    if (reach > GRID_MAX_REACH)
+    {
+        reach = GRID_MAX_REACH;
+        cell_size = (diameter + GRID_MAX_REACH - 1) / GRID_MAX_REACH;
+    }
+
+    broad_phase->grid_choice.cell_size = cell_size;
+    broad_phase->grid_choice.reach = reach;
+    broad_phase->grid_choice.estimated_pairs = 0.0;
+    hashed_grid_resize(broad_phase->hashed_grid, cell_size, reach);
+}
+
+void hashed_backend_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    HashedGrid* grid = broad_phase->hashed_grid;
+
+    hashed_grid_clear(grid);
+    for (int i = 0; i < circles->count; i++)
+        hashed_grid_insert(grid, i, circles->x[i], circles->y[i]);
+    hashed_grid_sort(grid);
+}
+
+void hashed_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    (void)pool;
+    ccoll_rebound_velocity_hashed(broad_phase->hashed_grid, circles, stats, broad_phase->pair_log, broad_phase->contact_log);
+}
+
+void hashed_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    hashed_grid_get_occupancy(broad_phase->hashed_grid, occupied, max_occupancy);
+}
+
+void no_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    (void)broad_phase;
+    *occupied = 0;
+    *max_occupancy = 0;
+}
+
+// --- auto ---
+// Each backend runs the real simulation for BROAD_PHASE_TRIAL_STEPS steps, so nothing is wasted and the
+// circles see no difference. Build plus collide time is added up over all but the first step of each trial,
+// then the backend with the lowest total is created again and kept.
+
+void auto_backend_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h)
+{
+    broad_phase_fit(broad_phase->active, circles, world_w, world_h);
+}
+
+void auto_backend_build(BroadPhase* broad_phase, CircleStore* circles)
+{
+    if (!broad_phase->trial_done)
+    {
+        int trial = broad_phase->trial_step / BROAD_PHASE_TRIAL_STEPS;
+
+        // the previous trial is over, move on to the next backend
+        if (broad_phase->trial_step % BROAD_PHASE_TRIAL_STEPS == 0 && trial != (int)broad_phase->active->type)
+        {
+            broad_phase_destroy(broad_phase->active);
+            broad_phase->active = broad_phase_create(trial, broad_phase->settings, circles, broad_phase->world_width, broad_phase->world_height);
+        }
+
+        // the time is collected in auto_backend_collide
+        broad_phase->trial_ns[trial] -= profiler_now_ns();
+    }
+
+    broad_phase_build(broad_phase->active, circles);
+}
+
+void auto_backend_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats)
+{
+    // the backend being tried may have only just been created, so it's handed the logs every step
+    CollisionStats step_stats;
+    broad_phase->active->pair_log = broad_phase->pair_log;
+    broad_phase->active->contact_log = broad_phase->contact_log;
+    broad_phase_collide(broad_phase->active, circles, pool, &step_stats);
+    if (stats)
+        *stats = step_stats;
+
+    if (broad_phase->trial_done)
+        return;
+
+    int trial = broad_phase->trial_step / BROAD_PHASE_TRIAL_STEPS;
+    if (broad_phase->trial_step % BROAD_PHASE_TRIAL_STEPS == 0)
+        broad_phase->trial_ns[trial] = 0; // the warm up step doesn't count
+    else
+    {
+        broad_phase->trial_ns[trial] += profiler_now_ns();
+        broad_phase->trial_pairs[trial] += step_stats.candidate_pairs;
+    }
+
+    broad_phase->trial_step++;
+    if (broad_phase->trial_step < BROAD_PHASE_AUTO * BROAD_PHASE_TRIAL_STEPS)
+        return;
+
+    BroadPhaseType fastest = 0;
+    for (int type = 1; type < BROAD_PHASE_AUTO; type++)
+    {
+        if (broad_phase->trial_ns[type] < broad_phase->trial_ns[fastest])
+            fastest = type;
+    }
+
+    if (fastest != broad_phase->active->type)
+    {
+        broad_phase_destroy(broad_phase->active);
+        broad_phase->active = broad_phase_create(fastest, broad_phase->settings, circles, broad_phase->world_width, broad_phase->world_height);
+    }
+    broad_phase->trial_done = true;
+}
+
+void auto_backend_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy)
+{
+    broad_phase_get_occupancy(broad_phase->active, occupied, max_occupancy);
+}
@@ -0,0 +1,106 @@
+#ifndef BROAD_PHASE_H
+#define BROAD_PHASE_H
+
+#include <stdint.h>
+
+#include "../circle/circle.h"
+#include "../hashed_grid/hashed_grid.h"
+#include "../collision/circle_collider/circle_collider.h"
+#include "../hierarchical_grid/hierarchical_grid.h"
+#include "../loose_quadtree/loose_quadtree.h"
+#include "../neighbour_list/neighbour_list.h"
+#include "../spatial_grid/spatial_grid.h"
+#include "../sweep_and_prune/sweep_and_prune.h"
+#include "../thread_pool/thread_pool.h"
+
+// How the physics finds pairs of circles that might be touching.
+typedef enum
+{
+    BROAD_PHASE_GRID,              // one uniform grid, best when the circles are all about the same size
+    BROAD_PHASE_HIERARCHICAL_GRID, // a level per power-of-two cell size, for a wide spread of radii
+    BROAD_PHASE_SWEEP_AND_PRUNE,   // boxes kept sorted along x, for clustered scenes where no one cell size fits
+    BROAD_PHASE_LOOSE_QUADTREE,    // only builds nodes where there are circles, for clustered or mostly empty worlds
+    BROAD_PHASE_HASHED_GRID,       // a grid with no edges, only the cells in use exist. for huge, sparse worlds
+    BROAD_PHASE_AUTO,              // tries each of the above for a few steps and keeps the fastest
+    BROAD_PHASE_TYPE_COUNT
+} BroadPhaseType;
+
+extern const char* broad_phase_names[BROAD_PHASE_TYPE_COUNT];
+
+// What every backend needs to be told, on top of the circles and the world size.
+typedef struct
+{
+    int cell_size;        // grid cell size in pixels, 0 lets the grid pick one from the circles (see grid_choose_cell_size)
+    float neighbour_skin; // > 0 puts a neighbour list on top of the grid, see neighbour_list.h. Only used by BROAD_PHASE_GRID.
+    bool incremental_grid; // keeps the grid between steps and only moves the circles that changed cell. Only used by BROAD_PHASE_GRID.
+} BroadPhaseSettings;
+
+// Steps each backend gets in BROAD_PHASE_AUTO. The first one isn't timed, it's where anything
+// that keeps state between steps (like sweep and prune's order) gets set up.
+#define BROAD_PHASE_TRIAL_STEPS 8
+
+typedef struct BroadPhase BroadPhase;
+
+// What each backend has to provide.
+typedef struct
+{
+    // refits to the current circles and world. whatever was built is thrown away.
+    void (*fit)(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+    // builds (or brings up to date) the structure from where the circles are now
+    void (*build)(BroadPhase* broad_phase, CircleStore* circles);
+    // optional: remembers the positions, moves the circles and builds, all in one pass over them split across the pool.
+    // returns false (having done nothing) if it can't this step. NULL for backends that never can.
+    bool (*move_and_build)(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool);
+    // goes through every candidate pair and hands it to the collider to resolve
+    void (*collide)(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+    // cells/nodes with something in them, and the most in any one. both 0 if that doesn't mean anything for the backend.
+    void (*get_occupancy)(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+} BroadPhaseBackend;
+
+// Only the structure for the backend in use is created, the rest stay NULL.
+struct BroadPhase
+{
+    BroadPhaseType type;
+    const BroadPhaseBackend* backend;
+    BroadPhaseSettings settings;
+    int world_width;
+    int world_height;
+
+    SpatialGrid* grid;
+    GridCellChoice grid_choice; // the grid's current cell size
+    int64_t grid_layout_version; // the store's layout_version the incremental grid was laid out for
+    NeighbourList* nlist;
+    HierarchicalGrid* hgrid;
+    SweepAndPrune* sap;
+    LooseQuadtree* quadtree;
+    HashedGrid* hashed_grid;
+
+    CollisionPairLog* pair_log; // NULL unless the candidate pairs are being checked, see broad_phase_set_pair_log
+    CollisionPairLog* contact_log; // NULL unless something wants the pairs that touched, see broad_phase_set_contact_log
+
+    // BROAD_PHASE_AUTO only: the backend being tried (or the one that won), and what each one cost
+    BroadPhase* active;
+    int trial_step;
+    bool trial_done;
+    int64_t trial_ns[BROAD_PHASE_AUTO];
+    int64_t trial_pairs[BROAD_PHASE_AUTO];
+};
+
+BroadPhase* broad_phase_create(BroadPhaseType type, BroadPhaseSettings settings, CircleStore* circles, int world_w, int world_h);
+void broad_phase_fit(BroadPhase* broad_phase, CircleStore* circles, int world_w, int world_h);
+void broad_phase_build(BroadPhase* broad_phase, CircleStore* circles);
+// Moves the circles and builds in one go, if the backend can. Returns false if it can't, then it's circle_move and broad_phase_build as usual.
+bool broad_phase_move_and_build(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool);
+void broad_phase_collide(BroadPhase* broad_phase, CircleStore* circles, ThreadPool* pool, CollisionStats* stats);
+void broad_phase_get_occupancy(BroadPhase* broad_phase, int* occupied, int* max_occupancy);
+// Records every candidate pair (and where the circles were) into log on each broad_phase_collide from now on.
+// The broad phase doesn't own the log. Pass NULL to stop.
+void broad_phase_set_pair_log(BroadPhase* broad_phase, CollisionPairLog* log);
+// Adds every pair that was overlapping and got resolved to log on each broad_phase_collide from now on, without
+// emptying it first. Whoever owns the log empties it. Pass NULL to stop.
+void broad_phase_set_contact_log(BroadPhase* broad_phase, CollisionPairLog* log);
+// The backend doing the work: broad_phase itself, or for BROAD_PHASE_AUTO whichever one it's on.
+BroadPhase* broad_phase_current(BroadPhase* broad_phase);
+void broad_phase_destroy(BroadPhase* broad_phase);
+
+#endif
@@ -2,21 +2,107 @@
 #define CIRCLE_H
 
 #include <allegro5/color.h>
+#include <stdint.h>
 
+#include "../random/random.h"
+
+// All circles live in one CircleStore as a structure of arrays: circle i is
+// x[i], y[i], vx[i], vy[i], radius[i] and colour[i].
+// previous_x/previous_y hold where each circle was before the latest physics tick, for drawing in between ticks.
+// Keeping each field contiguous means the per-frame passes (moving, bouncing off walls)
+// stream through memory in order and can work on several circles per SIMD instruction.
+// The float arrays are 32-byte aligned and their capacity is a multiple of 8 (one AVX register).
+//
+// Removing a circle moves the last one into its place, so the live circles are always 0..count-1 with no holes,
+// but an index only means the same circle until the next add or remove. Anything that has to keep hold of
+// a circle for longer keeps a CircleHandle instead. Each circle owns a slot (its id), and slot_index says
+// where that slot's circle is in the store right now. Slots are reused through a free list, and the slot's
+// generation goes up every time it's freed, so a handle to a removed circle stops working rather than
+// quietly pointing at whichever circle got the slot next.
+typedef struct
+{
+    int count;
+    int capacity;
+    int* id; // the circle's slot. unique among the live circles, and it goes with the circle when the store is reordered
+    float* x;
+    float* y;
+    float* previous_x;
+    float* previous_y;
+    float* vx;
+    float* vy;
+    float* radius;
+    ALLEGRO_COLOR* colour;
+    // set by the collider when a circle hits something, circle_recolour_collided picks a new colour once per step.
+    // one byte per circle, so threads working on different circles never write to the same value.
+    uint8_t* collided;
+    // see sleep.h. a sleeping circle has no velocity and the collider doesn't test it against other sleeping circles.
+    // the collider wakes a circle (and clears its still_steps) when something runs into it: CIRCLE_WOKEN until the
+    // step's collisions are over, still asleep as far as finding pairs goes, then sleep_update sets it to 0.
+    uint8_t* asleep;
+    uint8_t* still_steps; // steps in a row it's been slower than the sleep speed, stops counting at 255
+
+    // how much of the speed along the line between two circles is kept when they bounce (see ccoll_apply_rebound_velocities).
+    // 1 (the default) loses nothing, less than 1 loses some on every bounce.
+    float restitution;
+    // fraction of its velocity every circle loses each step, as if moving through something thick. 0 (the default) loses nothing.
+    float damping;
+
+    uint64_t seed; // every random number about a circle comes from this, the circle and a counter, see random.h
+
+    int slot_count;         // slots handed out so far, never more than capacity
+    int* slot_index;        // store index of each slot's circle, or the next free slot if it's free
+    int* slot_generation;   // bumped every time the slot is freed
+    int free_slot;          // head of the free list, -1 when it's empty
+    int64_t layout_version; // bumped whenever a circle is added, removed or moved to another index
+} CircleStore;
+
+// asleep values, besides 0 for awake
+#define CIRCLE_ASLEEP 1
+#define CIRCLE_WOKEN 2
+
+// Names one circle for as long as it lives. Stale handles (to removed circles) are caught, see circle_from_handle.
 typedef struct
 {
+    int slot;
+    int generation;
+} CircleHandle;
+
+CircleStore* circle_store_create(int capacity, uint64_t seed);
+void circle_store_destroy(CircleStore* circles);
+// Makes room for capacity circles in one go, so adding up to that many doesn't allocate.
+void circle_store_reserve(CircleStore* circles, int capacity);
+// Makes to a copy of everything needed to draw from (ids, positions, previous positions, radii and colours).
+// Velocities aren't copied. to grows if it has to, so copying every tick doesn't allocate once it's big enough.
+void circle_store_copy_for_drawing(CircleStore* to, CircleStore* from);
+
+// Moves every circle to a new index: the circle at order[i] ends up at i. order has to list every index once.
+// Handles still find their circles afterwards, and ids (slots) go with the circles, so nothing keyed by id changes.
+void circle_store_permute(CircleStore* circles, const int* order);
 
-    int id;
-    ALLEGRO_COLOR colour;
-    float radius;
-    float position[2]; // position[0] = x, position[1] = y
-    float velocity[2]; // velocity[0] = x, velocity[1] = y
-} Circle;
-
-Circle* circle_create(int id, float min_radius, float max_radius);
-void circle_place(Circle* c, float position_x, float position_y, int max_speed);
-void circle_move(Circle* c);
-void circle_draw(Circle* c, bool filled);
-void circle_change_colour(Circle* c);
+// Adds a circle with a random radius and colour, and returns its index in the store.
+// The radius and colour come from the circle's own random numbers, not from whatever was created before it.
+int circle_create(CircleStore* circles, float min_radius, float max_radius);
+// Removes the circle at index by moving the last circle into its place. O(1), nothing is freed.
+void circle_destroy(CircleStore* circles, int index);
+CircleHandle circle_handle(CircleStore* circles, int index);
+// The handle's circle's index in the store right now, or -1 if it's been removed.
+int circle_from_handle(CircleStore* circles, CircleHandle handle);
+// Which random numbers are this circle's. A new circle in a reused slot gets different ones, the generation is part of it.
+uint64_t circle_random_key(CircleStore* circles, int index);
+// Puts the circle at (position_x, position_y) with a random velocity of 1 to max_speed - 1 along each axis.
+void circle_place(CircleStore* circles, int index, float position_x, float position_y, int max_speed);
+// Copies x/y into previous_x/previous_y. Call once per tick before anything moves.
+void circle_remember_positions(CircleStore* circles);
+// Slows each circle down by the store's damping, then moves it by its velocity. Sleeping circles stay where they are.
+void circle_move(CircleStore* circles);
+// Both of the above for circles [begin, end) only, so the work can be split up between threads.
+void circle_remember_positions_range(CircleStore* circles, int begin, int end);
+void circle_move_range(CircleStore* circles, int begin, int end);
+// alpha 0 draws the circle where it was before the last tick, 1 where it is now
+void circle_draw(CircleStore* circles, int index, bool filled, float alpha);
+// A random colour that only depends on the circle and step, so it doesn't matter who calls it or in what order.
+void circle_change_colour(CircleStore* circles, int index, int64_t step);
+// Gives every circle the collider marked as collided a new colour and clears the marks. Once per step, after the collisions.
+void circle_recolour_collided(CircleStore* circles, int64_t step);
 
 #endif
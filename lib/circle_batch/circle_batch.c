@@ -0,0 +1,167 @@
+#include "circle_batch.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define CIRCLE_BATCH_MIN_SEGMENTS 8
+#define CIRCLE_BATCH_MAX_SEGMENTS 64
+#define CIRCLE_BATCH_OUTLINE_THICKNESS 2.0f
+
+// private prototypes
+int circle_batch_segments(float radius);
+void circle_batch_reserve(CircleBatch* batch, int vertex_count, int index_count);
+void circle_batch_add_filled(CircleBatch* batch, float x, float y, float radius, ALLEGRO_COLOR colour);
+void circle_batch_add_outline(CircleBatch* batch, float x, float y, float radius, ALLEGRO_COLOR colour);
+
+CircleBatch* circle_batch_create(void)
+{
+    CircleBatch* batch = malloc(sizeof(CircleBatch));
+    batch->vertices = NULL;
+    batch->indices = NULL;
+    batch->vertex_capacity = 0;
+    batch->index_capacity = 0;
+    batch->vertex_count = 0;
+    batch->index_count = 0;
+    return batch;
+}
+
+// Bigger circles get more segments so they stay round, small ones don't waste triangles.
+int circle_batch_segments(float radius)
+{
+    int segments = (int)(sqrtf(radius) * 6.0f);
+    if (segments < CIRCLE_BATCH_MIN_SEGMENTS)
+        return CIRCLE_BATCH_MIN_SEGMENTS;
+    if (segments > CIRCLE_BATCH_MAX_SEGMENTS)
+        return CIRCLE_BATCH_MAX_SEGMENTS;
+    return segments;
+}
+
+void circle_batch_reserve(CircleBatch* batch, int vertex_count, int index_count)
+{
+    if (vertex_count > batch->vertex_capacity)
+    {
+        batch->vertex_capacity = vertex_count;
+        batch->vertices = realloc(batch->vertices, vertex_count * sizeof(ALLEGRO_VERTEX));
+    }
+    if (index_count > batch->index_capacity)
+    {
+        batch->index_capacity = index_count;
+        batch->indices = realloc(batch->indices, index_count * sizeof(int));
+    }
+}
+
+void circle_batch_draw(CircleBatch* batch, CircleStore* circles, bool filled, float alpha)
+{
+    // work out how much room this frame needs first, so the arrays grow at most once
+    int vertex_count = 0;
+    int index_count = 0;
+    for (int i = 0; i < circles->count; i++)
+    {
+        int segments = circle_batch_segments(circles->radius[i]);
+        vertex_count += filled ? segments + 1 : segments * 2;
+        index_count += filled ? segments * 3 : segments * 6;
+    }
+    circle_batch_reserve(batch, vertex_count, index_count);
+
+    batch->vertex_count = 0;
+    batch->index_count = 0;
+
+    for (int i = 0; i < circles->count; i++)
+    {
+        float x = circles->previous_x[i] + (circles->x[i] - circles->previous_x[i]) * alpha;
+        float y = circles->previous_y[i] + (circles->y[i] - circles->previous_y[i]) * alpha;
+
+        if (filled)
+            circle_batch_add_filled(batch, x, y, circles->radius[i], circles->colour[i]);
+        else
+            circle_batch_add_outline(batch, x, y, circles->radius[i], circles->colour[i]);
+    }
+
+    if (batch->index_count > 0)
+        al_draw_indexed_prim(batch->vertices, NULL, NULL, batch->indices, batch->index_count, ALLEGRO_PRIM_TRIANGLE_LIST);
+}
+
+// A centre vertex plus one per segment around the edge, and a triangle from the centre to each edge.
+void circle_batch_add_filled(CircleBatch* batch, float x, float y, float radius, ALLEGRO_COLOR colour)
+{
+    int segments = circle_batch_segments(radius);
+    int centre = batch->vertex_count;
+
+    // walk around the circle by rotating a unit vector, rather than a cos/sin call per vertex
+    float step_cos = cosf(2.0f * ALLEGRO_PI / segments);
+    float step_sin = sinf(2.0f * ALLEGRO_PI / segments);
+    float dx = 1.0f;
+    float dy = 0.0f;
+
+    ALLEGRO_VERTEX* v = &batch->vertices[batch->vertex_count];
+    v[0] = (ALLEGRO_VERTEX){.x = x, .y = y, .z = 0, .u = 0, .v = 0, .color = colour};
+    for (int s = 1; s <= segments; s++)
+    {
+        v[s] = (ALLEGRO_VERTEX){.x = x + dx * radius, .y = y + dy * radius, .z = 0, .u = 0, .v = 0, .color = colour};
+        float next_dx = dx * step_cos - dy * step_sin;
+        dy = dx * step_sin + dy * step_cos;
+        dx = next_dx;
+    }
+    batch->vertex_count += segments + 1;
+
+    int* index = &batch->indices[batch->index_count];
+    for (int s = 0; s < segments; s++)
+    {
+        index[s * 3 + 0] = centre;
+        index[s * 3 + 1] = centre + 1 + s;
+        index[s * 3 + 2] = centre + 1 + (s + 1) % segments;
+    }
+    batch->index_count += segments * 3;
+}
+
+// An inner and an outer vertex per segment, joined up into two triangles per segment.
+// The ring is centred on the radius, the same as al_draw_circle.
+void circle_batch_add_outline(CircleBatch* batch, float x, float y, float radius, ALLEGRO_COLOR colour)
+{
+    int segments = circle_batch_segments(radius);
+    int first = batch->vertex_count;
+    float inner = radius - CIRCLE_BATCH_OUTLINE_THICKNESS / 2.0f;
+    float outer = radius + CIRCLE_BATCH_OUTLINE_THICKNESS / 2.0f;
+
+    float step_cos = cosf(2.0f * ALLEGRO_PI / segments);
+    float step_sin = sinf(2.0f * ALLEGRO_PI / segments);
+    float dx = 1.0f;
+    float dy = 0.0f;
+
+    ALLEGRO_VERTEX* v = &batch->vertices[batch->vertex_count];
+    for (int s = 0; s < segments; s++)
+    {
+        v[s * 2 + 0] = (ALLEGRO_VERTEX){.x = x + dx * inner, .y = y + dy * inner, .z = 0, .u = 0, .v = 0, .color = colour};
+        v[s * 2 + 1] = (ALLEGRO_VERTEX){.x = x + dx * outer, .y = y + dy * outer, .z = 0, .u = 0, .v = 0, .color = colour};
+        float next_dx = dx * step_cos - dy * step_sin;
+        dy = dx * step_sin + dy * step_cos;
+        dx = next_dx;
+    }
+    batch->vertex_count += segments * 2;
+
+    int* index = &batch->indices[batch->index_count];
+    for (int s = 0; s < segments; s++)
+    {
+        int inner_now = first + s * 2;
+        int outer_now = inner_now + 1;
+        int inner_next = first + ((s + 1) % segments) * 2;
+        int outer_next = inner_next + 1;
+
+        index[s * 6 + 0] = inner_now;
+        index[s * 6 + 1] = outer_now;
+        index[s * 6 + 2] = outer_next;
+        index[s * 6 + 3] = inner_now;
+        index[s * 6 + 4] = outer_next;
+        index[s * 6 + 5] = inner_next;
+    }
+    batch->index_count += segments * 6;
+}
+
+void circle_batch_destroy(CircleBatch* batch)
+{
+    if (batch)
+    {
+        free(batch->vertices);
+        free(batch->indices);
+        free(batch);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef CIRCLE_BATCH_H
+#define CIRCLE_BATCH_H
+
+#include <allegro5/allegro_primitives.h>
+
+#include "../circle/circle.h"
+
+// Draws every circle in a store with one al_draw_indexed_prim call instead of one primitive per circle.
+// Each circle is tessellated into triangles (a fan for filled, a ring for outlines) with its colour
+// baked into the vertices. The vertex and index arrays are kept between frames and only grow.
+// Plain triangles and no textures, so it also works on Allegro's software/memory bitmap path.
+typedef struct
+{
+    ALLEGRO_VERTEX* vertices;
+    int* indices;
+    int vertex_capacity;
+    int index_capacity;
+    int vertex_count;
+    int index_count;
+} CircleBatch;
+
+CircleBatch* circle_batch_create(void);
+// alpha works the same as circle_draw, 0 is the previous tick and 1 the latest
+void circle_batch_draw(CircleBatch* batch, CircleStore* circles, bool filled, float alpha);
+void circle_batch_destroy(CircleBatch* batch);
+
+#endif
@@ -2,85 +2,493 @@
 #include "../../spatial_grid/spatial_grid.h"
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The grid is cut into bands of whole rows, 2 * reach rows tall, numbered from the top.
+// A cell only touches circles up to reach rows away, so two even bands (or two odd ones) never touch the same circle:
+// there's a whole band between them. Every even band can be resolved at the same time without locks, then every odd one.
+// Inside a band the cells go row by row, the same order as a plain loop over the grid, so neighbouring cells stay in cache.
+// The bands don't depend on the thread count and each one runs start to finish on one thread,
+// so the result is the same bit for bit whether there's one thread or sixteen.
+
+// The narrow phase runs in two stages. Candidate pairs are only collected into a CcollBatch at first,
+// and when it fills up (or the caller is done) the whole batch is tested 8 (AVX2) or 4 (SSE) pairs at a time
+// on squared distances, so a miss never costs a sqrt or a branch of its own. Only the pairs that really overlap
+// go on to ccoll_calculate_circle_collision, which tests them again on the latest positions before resolving.
+// Most candidates are misses, so most of the work ends up in the vector loop.
+// A pair that only starts touching because another pair in the same batch was pushed apart is left for the next step.
+#define CCOLL_BATCH_SIZE 256
+
+typedef struct
+{
+    int count;
+    CollisionPairLog* log; // NULL unless someone is checking the broad phase
+    CollisionPairLog* contact_log; // NULL unless sleep wants the pairs that touched, see sleep.h
+    int first[CCOLL_BATCH_SIZE];
+    int second[CCOLL_BATCH_SIZE];
+    int hits[CCOLL_BATCH_SIZE]; // positions in first/second of the pairs that overlapped
+} CcollBatch;
+
+// each worker counts into its own cache line so the counters don't bounce between cores.
+// the alignment pads the struct out to a whole line and lines up every array of them (the stack one too) on line boundaries.
+typedef struct
+{
+    _Alignas(64) CollisionStats stats;
+} CcollWorkerStats;
+
+typedef struct
+{
+    SpatialGrid* grid;
+    CircleStore* circles;
+    CcollWorkerStats* worker_stats;
+    CollisionPairLog* log;
+    CollisionPairLog* contact_log;
+    int band_rows;
+    int parity; // 0 for the even bands, 1 for the odd ones
+} CcollBands;
 
 // private prototypes
-void ccoll_process_cell(SpatialGrid *grid, CircleList *cell);
-void ccoll_process_circle(Circle* c, CircleList* nearby);
-void ccoll_calculate_circle_collision(Circle* c1, Circle* c2);
-void ccoll_apply_rebound_velocities(Circle* c1, Circle* c2, float nx, float ny);
+void ccoll_process_band(void* context, int task_index, int worker);
+void ccoll_process_cell(SpatialGrid *grid, CircleStore* circles, CcollBatch* batch, int row, int col, CollisionStats* stats);
+void ccoll_process_circle(CircleStore* circles, CcollBatch* batch, int c1, const CircleSpan* spans, int span_count, CollisionStats* stats);
+void ccoll_process_coarser_levels(HierarchicalGrid* hgrid, CircleStore* circles, CcollBatch* batch, int c1, int level, CollisionStats* stats);
+void ccoll_query_quadtree(LooseQuadtree* tree, CircleStore* circles, CcollBatch* batch, int slot, CollisionStats* stats);
+void ccoll_batch_add(CcollBatch* batch, CircleStore* circles, int c1, int c2, CollisionStats* stats);
+void ccoll_pair_log_add(CollisionPairLog* log, const int* first, const int* second, int count);
+void ccoll_batch_flush(CcollBatch* batch, CircleStore* circles, CollisionStats* stats);
+bool ccoll_calculate_circle_collision(CircleStore* circles, int c1, int c2);
+void ccoll_apply_rebound_velocities(CircleStore* circles, int c1, int c2, float nx, float ny);
+void ccoll_wake(CircleStore* circles, int c1, int c2);
 
-void ccoll_rebound_velocity(SpatialGrid *grid)
+void ccoll_rebound_velocity(SpatialGrid *grid, CircleStore* circles, ThreadPool* pool, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log)
 {
-    for (int row_index = 0; row_index < grid->rows; row_index++)
+    CollisionStats totals = {0, 0};
+
+    // sort everything inserted this frame into its cell up front, the workers only read the grid
+    grid_sort(grid);
+
+    // without a pool the bands just run one after another on this thread, in the same order
+    int thread_count = pool ? pool->thread_count : 1;
+    CcollWorkerStats worker_stats[thread_count];
+    memset(worker_stats, 0, sizeof(worker_stats));
+
+    CcollBands bands;
+    bands.grid = grid;
+    bands.circles = circles;
+    bands.worker_stats = worker_stats;
+    bands.log = log;
+    bands.contact_log = contact_log;
+    bands.band_rows = 2 * grid->reach;
+
+    int band_count = (grid->rows + bands.band_rows - 1) / bands.band_rows;
+
+    // pool_run doesn't return until every even band is done, so the odd ones never overlap them
+    for (bands.parity = 0; bands.parity < 2; bands.parity++)
     {
-        for (int col_index = 0; col_index < grid->columns; col_index++)
+        int band_tasks = (band_count - bands.parity + 1) / 2;
+
+        if (pool)
+            pool_run(pool, band_tasks, ccoll_process_band, &bands);
+        else
         {
-            CircleList *cell = &grid->cells[row_index][col_index];
-            ccoll_process_cell(grid, cell);
+            for (int task = 0; task < band_tasks; task++)
+                ccoll_process_band(&bands, task, 0);
         }
     }
+
+    for (int worker = 0; worker < thread_count; worker++)
+    {
+        totals.candidate_pairs += worker_stats[worker].stats.candidate_pairs;
+        totals.contacts += worker_stats[worker].stats.contacts;
+    }
+
+    if (stats)
+        *stats = totals;
 }
 
-void ccoll_process_cell(SpatialGrid *grid, CircleList *cell)
+void ccoll_rebound_velocity_hierarchical(HierarchicalGrid* hgrid, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log)
 {
-    if (cell->count == 0)
-        return;
+    CollisionStats totals = {0, 0};
+    CcollBatch batch;
+    batch.count = 0;
+    batch.log = log;
+    batch.contact_log = contact_log;
 
-    
-    CircleNode* current = cell->head;
-    
-    // get nearby circles from neighbouring cells once for this cell
-    CircleList nearbyCircles;
-    grid_get_nearby_circles(grid, current->circle, &nearbyCircles);
+    for (int level = 0; level < hgrid->level_count; level++)
+    {
+        if (hgrid->level_population[level] == 0)
+            continue;
 
-    // for each circle in the cell, we need to check whether they rebound against other nearby circles (including those in neighbouring cells)
-    while(current != NULL)
+        SpatialGrid* grid = hgrid->levels[level];
+        grid_sort(grid);
+
+        for (int row_index = 0; row_index < grid->rows; row_index++)
+        {
+            for (int col_index = 0; col_index < grid->columns; col_index++)
+            {
+                CircleSpan cell = grid_get_cell(grid, row_index, col_index);
+                if (cell.begin == cell.end)
+                    continue;
+
+                // pairs on this level, exactly like the flat grid
+                ccoll_process_cell(grid, circles, &batch, row_index, col_index, &totals);
+
+                // pairs with bigger circles on the levels above
+                for (int* c = cell.begin; c != cell.end; c++)
+                    ccoll_process_coarser_levels(hgrid, circles, &batch, *c, level, &totals);
+            }
+        }
+    }
+    ccoll_batch_flush(&batch, circles, &totals);
+
+    if (stats)
+        *stats = totals;
+}
+
+// A circle on level L can reach a circle on level M > L only if the centres are less than a level M cell apart
+// (both radii are at most half a level M cell), so the 3x3 block around it on level M covers everything.
+// Each cross-level pair is only ever found from the smaller circle's side, so no index check is needed.
+void ccoll_process_coarser_levels(HierarchicalGrid* hgrid, CircleStore* circles, CcollBatch* batch, int c1, int level, CollisionStats* stats)
+{
+    for (int coarser = level + 1; coarser < hgrid->level_count; coarser++)
+    {
+        if (hgrid->level_population[coarser] == 0)
+            continue;
+
+        SpatialGrid* grid = hgrid->levels[coarser];
+        int row, col;
+        grid_cell_of(grid, circles->x[c1], circles->y[c1], &row, &col);
+
+        GridNeighbourhood nearby;
+        grid_get_neighbourhood(grid, row, col, &nearby);
+
+        for (int span = 0; span < nearby.span_count; span++)
+        {
+            for (int* current = nearby.spans[span].begin; current != nearby.spans[span].end; current++)
+                ccoll_batch_add(batch, circles, c1, *current, stats);
+        }
+    }
+}
+
+void ccoll_rebound_velocity_pairs(NeighbourList* list, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log)
+{
+    CollisionStats totals = {0, 0};
+    CcollBatch batch;
+    batch.count = 0;
+    batch.log = log;
+    batch.contact_log = contact_log;
+
+    // the list was built with the same index check as ccoll_process_circle, so every pair is already unique
+    for (int pair = 0; pair < list->pair_count; pair++)
+        ccoll_batch_add(&batch, circles, list->first[pair], list->second[pair], &totals);
+    ccoll_batch_flush(&batch, circles, &totals);
+
+    if (stats)
+        *stats = totals;
+}
+
+void ccoll_rebound_velocity_sweep(SweepAndPrune* sap, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log)
+{
+    CollisionStats totals = {0, 0};
+    SapEntry* entries = sap->entries;
+    CcollBatch batch;
+    batch.count = 0;
+    batch.log = log;
+    batch.contact_log = contact_log;
+
+    for (int i = 0; i < sap->count; i++)
     {
-        Circle* c = current->circle;
-        //CircleList nearbyCircles;
-        //grid_get_nearby_circles(grid, c, &nearbyCircles);
-        
-        ccoll_process_circle(c, &nearbyCircles);
+        SapEntry* first = &entries[i];
+
+        // everything after this starts further right, so once one starts past our right edge the rest do too
+        for (int j = i + 1; j < sap->count && entries[j].min_x <= first->max_x; j++)
+        {
+            SapEntry* second = &entries[j];
 
-        current = current->next;
+            // overlapping in x, but they also have to overlap in y to be worth a distance test
+            if (second->min_y > first->max_y || second->max_y < first->min_y)
+                continue;
+
+            ccoll_batch_add(&batch, circles, first->circle, second->circle, &totals);
+        }
     }
-    
-    // Free the nearby circles list to prevent memory leak
-    CircleNode* nearby_current = nearbyCircles.head;
-    while(nearby_current != NULL)
+    ccoll_batch_flush(&batch, circles, &totals);
+
+    if (stats)
+        *stats = totals;
+}
+
+void ccoll_rebound_velocity_quadtree(LooseQuadtree* tree, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log)
+{
+    CollisionStats totals = {0, 0};
+
+    quadtree_sort(tree, circles);
+
+    // every circle looks for its own neighbours, so each pair comes up twice and the index check keeps one.
+    // going node by node keeps circles that are close together next to each other in time too.
+    CcollBatch batch;
+    batch.count = 0;
+    batch.log = log;
+    batch.contact_log = contact_log;
+    for (int i = 0; i < tree->inserted; i++)
+        ccoll_query_quadtree(tree, circles, &batch, i, &totals);
+    ccoll_batch_flush(&batch, circles, &totals);
+
+    if (stats)
+        *stats = totals;
+}
+
+// Walks down every node whose box overlaps the box of the circle in slot (of the tree's sorted circles).
+// A node's box holds everything below it, so a node that doesn't overlap can't have anything underneath that does.
+// The boxes are from where the circles were when the tree was sorted, and circles resolved earlier in the pass
+// have been pushed since, so the circle's own box comes from the same place or touching pairs can be missed.
+void ccoll_query_quadtree(LooseQuadtree* tree, CircleStore* circles, CcollBatch* batch, int slot, CollisionStats* stats)
+{
+    int c1 = tree->circles[slot];
+    float radius = circles->radius[c1];
+    float min_x = tree->sorted_x[slot] - radius;
+    float max_x = tree->sorted_x[slot] + radius;
+    float min_y = tree->sorted_y[slot] - radius;
+    float max_y = tree->sorted_y[slot] + radius;
+
+    // depth first. each level can leave at most 3 siblings waiting
+    int stack[3 * QUADTREE_MAX_DEPTH + 4];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    // the root's box always holds the circle, everything pushed after it has been checked before going on the stack
+    while (stack_size > 0)
     {
-        CircleNode* next = nearby_current->next;
-        free(nearby_current);
-        nearby_current = next;
+        QuadtreeNode* node = &tree->nodes[stack[--stack_size]];
+
+        for (int* c2 = &tree->circles[node->start]; c2 != &tree->circles[node->start + node->count]; c2++)
+        {
+            if (c1 < *c2) // prevent duplicate and self-collision
+                ccoll_batch_add(batch, circles, c1, *c2, stats);
+        }
+
+        for (int quadrant = 0; quadrant < 4; quadrant++)
+        {
+            int child = node->children[quadrant];
+            if (child < 0)
+                continue;
+
+            QuadtreeNode* box = &tree->nodes[child];
+            if (max_x < box->min_x || min_x > box->max_x || max_y < box->min_y || min_y > box->max_y)
+                continue;
+
+            stack[stack_size++] = child;
+        }
     }
-    
-    
 }
 
-void ccoll_process_circle(Circle* c1, CircleList* nearby)
+void ccoll_rebound_velocity_hashed(HashedGrid* grid, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log)
 {
-    if(nearby->count == 0)
+    CollisionStats totals = {0, 0};
+
+    hashed_grid_sort(grid);
+    CcollBatch batch;
+    batch.count = 0;
+    batch.log = log;
+    batch.contact_log = contact_log;
+
+    // only the cells in use exist, so walk those rather than rows and columns
+    for (int index = 0; index < grid->used_count; index++)
+    {
+        int row, col;
+        CircleSpan cell = hashed_grid_get_used_cell(grid, index, &row, &col);
+
+        HashedNeighbourhood nearby;
+        hashed_grid_get_neighbourhood(grid, row, col, &nearby);
+
+        for (int* c = cell.begin; c != cell.end; c++)
+            ccoll_process_circle(circles, &batch, *c, nearby.spans, nearby.span_count, &totals);
+    }
+    ccoll_batch_flush(&batch, circles, &totals);
+
+    if (stats)
+        *stats = totals;
+}
+
+void ccoll_process_band(void* context, int task_index, int worker)
+{
+    CcollBands* bands = context;
+    int first_row = (task_index * 2 + bands->parity) * bands->band_rows;
+    int last_row = first_row + bands->band_rows;
+    if (last_row > bands->grid->rows)
+        last_row = bands->grid->rows;
+    CollisionStats* stats = &bands->worker_stats[worker].stats;
+
+    // nothing else running now touches the circles around this band, so the batch can wait until the band is done
+    CcollBatch batch;
+    batch.count = 0;
+    batch.log = bands->log;
+    batch.contact_log = bands->contact_log;
+
+    for (int row = first_row; row < last_row; row++)
+    {
+        for (int col = 0; col < bands->grid->columns; col++)
+            ccoll_process_cell(bands->grid, bands->circles, &batch, row, col, stats);
+    }
+    ccoll_batch_flush(&batch, bands->circles, stats);
+}
+
+void ccoll_process_cell(SpatialGrid *grid, CircleStore* circles, CcollBatch* batch, int row, int col, CollisionStats* stats)
+{
+    CircleSpan cell = grid_get_cell(grid, row, col);
+    if (cell.begin == cell.end)
+        return;
+
+    // look up the neighbourhood once for the whole cell. this points straight into the grid, nothing is copied.
+    GridNeighbourhood nearby;
+    grid_get_neighbourhood(grid, row, col, &nearby);
+
+    // for each circle in the cell, we need to check whether they rebound against other nearby circles (including those in neighbouring cells)
+    for (int* c = cell.begin; c != cell.end; c++)
+        ccoll_process_circle(circles, batch, *c, nearby.spans, nearby.span_count, stats);
+}
+
+void ccoll_process_circle(CircleStore* circles, CcollBatch* batch, int c1, const CircleSpan* spans, int span_count, CollisionStats* stats)
+{
+    // sleeping circles don't look for anything, the awake circles around them find them instead (see below)
+    if (circles->asleep[c1])
         return;
 
-    //printf("Circle %d checking %d nearby circles\n", c1->id, nearby->count);
+    //printf("Circle %d checking nearby circles\n", circles->id[c1]);
 
-    CircleNode* current = nearby->head;
-    while(current != NULL)
+    for (int span = 0; span < span_count; span++)
     {
-        Circle* c2 = current->circle;
-        if(c1->id < c2->id) // prevent duplicate and self-collision
-            ccoll_calculate_circle_collision(c1, c2);
-        
-        current = current->next;
+        for (int* current = spans[span].begin; current != spans[span].end; current++)
+        {
+            int c2 = *current;
+            // prevent duplicate and self-collision. indexes rather than ids: nothing moves in the store during a step,
+            // and a sorted store (see spatial_order.h) has each cell's circles in index order, so this branch is predictable.
+            // a sleeping c2 never looks for c1, so that pair is c1's whichever index is lower
+            if (c1 < c2 || circles->asleep[c2])
+                ccoll_batch_add(batch, circles, c1, c2, stats);
+        }
     }
 }
 
-void ccoll_calculate_circle_collision(Circle* c1, Circle* c2)
+void ccoll_batch_add(CcollBatch* batch, CircleStore* circles, int c1, int c2, CollisionStats* stats)
+{
+    // neither is going anywhere, so there's nothing for them to do to each other. every broad phase comes through here.
+    if (circles->asleep[c1] && circles->asleep[c2])
+        return;
+
+    batch->first[batch->count] = c1;
+    batch->second[batch->count] = c2;
+    batch->count++;
+    stats->candidate_pairs++;
+
+    if (batch->count == CCOLL_BATCH_SIZE)
+        ccoll_batch_flush(batch, circles, stats);
+}
+
+// Tests every pair in the batch, then resolves the ones that overlapped in the order they were added.
+// Squared distances are enough to throw a pair out: sqrt is monotonic, so anything that passes here
+// and fails the exact test in ccoll_calculate_circle_collision is only a rounding hair away.
+void ccoll_batch_flush(CcollBatch* batch, CircleStore* circles, CollisionStats* stats)
 {
-    float dx = c2->position[0] - c1->position[0];
-    float dy = c2->position[1] - c1->position[1];
+    const float* x = circles->x;
+    const float* y = circles->y;
+    const float* radius = circles->radius;
+    const int* first = batch->first;
+    const int* second = batch->second;
+    int hit_count = 0;
+    int i = 0;
+
+    if (batch->log)
+        ccoll_pair_log_add(batch->log, first, second, batch->count);
+
+#if defined(__AVX2__)
+    for (; i + 8 <= batch->count; i += 8)
+    {
+        __m256i c1 = _mm256_loadu_si256((const __m256i*)&first[i]);
+        __m256i c2 = _mm256_loadu_si256((const __m256i*)&second[i]);
+
+        __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(x, c2, 4), _mm256_i32gather_ps(x, c1, 4));
+        __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(y, c2, 4), _mm256_i32gather_ps(y, c1, 4));
+        __m256 radius_sum = _mm256_add_ps(_mm256_i32gather_ps(radius, c1, 4), _mm256_i32gather_ps(radius, c2, 4));
+        __m256 distance_squared = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+
+        // one bit per pair that overlaps, then pull the set bits out lowest first
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(distance_squared, _mm256_mul_ps(radius_sum, radius_sum), _CMP_LT_OQ));
+        while (mask)
+        {
+            batch->hits[hit_count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    // no gather instruction, so the loads are scalar but the arithmetic and the compare still go 4 wide
+    for (; i + 4 <= batch->count; i += 4)
+    {
+        __m128 x1 = _mm_set_ps(x[first[i + 3]], x[first[i + 2]], x[first[i + 1]], x[first[i]]);
+        __m128 y1 = _mm_set_ps(y[first[i + 3]], y[first[i + 2]], y[first[i + 1]], y[first[i]]);
+        __m128 r1 = _mm_set_ps(radius[first[i + 3]], radius[first[i + 2]], radius[first[i + 1]], radius[first[i]]);
+        __m128 x2 = _mm_set_ps(x[second[i + 3]], x[second[i + 2]], x[second[i + 1]], x[second[i]]);
+        __m128 y2 = _mm_set_ps(y[second[i + 3]], y[second[i + 2]], y[second[i + 1]], y[second[i]]);
+        __m128 r2 = _mm_set_ps(radius[second[i + 3]], radius[second[i + 2]], radius[second[i + 1]], radius[second[i]]);
+
+        __m128 dx = _mm_sub_ps(x2, x1);
+        __m128 dy = _mm_sub_ps(y2, y1);
+        __m128 radius_sum = _mm_add_ps(r1, r2);
+        __m128 distance_squared = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(distance_squared, _mm_mul_ps(radius_sum, radius_sum)));
+        while (mask)
+        {
+            batch->hits[hit_count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < batch->count; i++)
+    {
+        float dx = x[second[i]] - x[first[i]];
+        float dy = y[second[i]] - y[first[i]];
+        float radius_sum = radius[first[i]] + radius[second[i]];
+        if (dx * dx + dy * dy < radius_sum * radius_sum)
+            batch->hits[hit_count++] = i;
+    }
+
+    // the positions may have moved since the test above, ccoll_calculate_circle_collision checks again.
+    // the pairs that touched are packed into the front of first/second as they go, for the contact log. hits only
+    // go up, so nothing is overwritten before it's been read.
+    int contact_count = 0;
+    for (int hit = 0; hit < hit_count; hit++)
+    {
+        int pair = batch->hits[hit];
+        if (!ccoll_calculate_circle_collision(circles, first[pair], second[pair]))
+            continue;
+
+        stats->contacts++;
+        batch->first[contact_count] = first[pair];
+        batch->second[contact_count] = second[pair];
+        contact_count++;
+    }
+
+    if (batch->contact_log)
+        ccoll_pair_log_add(batch->contact_log, batch->first, batch->second, contact_count);
+    batch->count = 0;
+}
+
+// Returns true if the circles were overlapping (and have now been pushed apart).
+bool ccoll_calculate_circle_collision(CircleStore* circles, int c1, int c2)
+{
+    float dx = circles->x[c2] - circles->x[c1];
+    float dy = circles->y[c2] - circles->y[c1];
     float distance = sqrtf(dx * dx + dy * dy);
-    float radius_sum = c1->radius + c2->radius;
+    float radius_sum = circles->radius[c1] + circles->radius[c2];
 
     if (distance < radius_sum)
     {
@@ -105,43 +513,131 @@ void ccoll_calculate_circle_collision(Circle* c1, Circle* c2)
         // Adding a small epsilon (0.001f) can prevent them from re-colliding immediately.
         float separation = overlap * 0.5f + 0.001f;
 
-        c1->position[0] -= separation * nx;
-        c1->position[1] -= separation * ny;
-        c2->position[0] += separation * nx;
-        c2->position[1] += separation * ny;
+        circles->x[c1] -= separation * nx;
+        circles->y[c1] -= separation * ny;
+        circles->x[c2] += separation * nx;
+        circles->y[c2] += separation * ny;
 
         // 2. Apply Collision Response (Velocity Rebound)
-        ccoll_apply_rebound_velocities(c1, c2, nx, ny);
+        ccoll_apply_rebound_velocities(circles, c1, c2, nx, ny);
+
+        // mark both for a new colour. circle_recolour_collided does the actual colouring once the step's collisions are done,
+        // so there's no random numbers or Allegro calls in here
+        circles->collided[c1] = 1;
+        circles->collided[c2] = 1;
+        return true;
+    }
+
+    return false;
+}
 
-        // change the colour of the circles to a random colour
-        circle_change_colour(c1);
-        circle_change_colour(c2);
+// Woken circles count as asleep until the step's collisions are done (sleep_update clears them), so which pairs
+// get tested doesn't depend on what got woken first. Otherwise a pair could be tested from both ends.
+void ccoll_wake(CircleStore* circles, int c1, int c2)
+{
+    if (circles->asleep[c1])
+    {
+        circles->asleep[c1] = CIRCLE_WOKEN;
+        circles->still_steps[c1] = 0;
+    }
+    if (circles->asleep[c2])
+    {
+        circles->asleep[c2] = CIRCLE_WOKEN;
+        circles->still_steps[c2] = 0;
     }
 }
 
-void ccoll_apply_rebound_velocities(Circle* c1, Circle* c2, float nx, float ny)
+void ccoll_apply_rebound_velocities(CircleStore* circles, int c1, int c2, float nx, float ny)
 {
     // Calculate relative velocity (c1_vel - c2_vel)
-    float dvx = c1->velocity[0] - c2->velocity[0];
-    float dvy = c1->velocity[1] - c2->velocity[1];
+    float dvx = circles->vx[c1] - circles->vx[c2];
+    float dvy = circles->vy[c1] - circles->vy[c2];
 
     // Calculate velocity along the normal (dot product)
     float velocity_along_normal = dvx * nx + dvy * ny;
 
     // Check if circles are already moving apart.
     // If so, do nothing to prevent 'sticky' collisions.
-    if (velocity_along_normal < 0.0f)
+    // (not moving at all along the normal gets no impulse either, so that's nothing to do too)
+    if (velocity_along_normal <= 0.0f)
         return;
 
-    // Coefficient of Restitution (e): 1.0f for perfect elastic collision (no energy loss)
-    float restitution = 1.0f;
+    // something ran into a sleeping circle. only when they're closing, a sleeping pile squeezed against a wall
+    // gets its overlaps pushed apart every step without anything moving, and that shouldn't keep it awake.
+    if (circles->asleep[c1] | circles->asleep[c2])
+        ccoll_wake(circles, c1, c2);
+
+    // Coefficient of Restitution (e): 1.0f for perfect elastic collision (no energy loss), less loses some every bounce
+    float restitution = circles->restitution;
 
     // Calculate collision impulse scalar
     float impulse = -(1.0f + restitution) * velocity_along_normal / 2.0f;
 
     // Apply the impulse to update velocities
-    c1->velocity[0] += impulse * nx;
-    c1->velocity[1] += impulse * ny;
-    c2->velocity[0] -= impulse * nx;
-    c2->velocity[1] -= impulse * ny;
+    circles->vx[c1] += impulse * nx;
+    circles->vy[c1] += impulse * ny;
+    circles->vx[c2] -= impulse * nx;
+    circles->vy[c2] -= impulse * ny;
+}
+
+CollisionPairLog* ccoll_pair_log_create(void)
+{
+    CollisionPairLog* log = malloc(sizeof(CollisionPairLog));
+    memset(log, 0, sizeof(CollisionPairLog));
+    pthread_mutex_init(&log->lock, NULL);
+    return log;
+}
+
+void ccoll_pair_log_begin(CollisionPairLog* log, CircleStore* circles)
+{
+    if (circles->count > log->position_capacity)
+    {
+        log->position_capacity = circles->count;
+        log->x = realloc(log->x, log->position_capacity * sizeof(float));
+        log->y = realloc(log->y, log->position_capacity * sizeof(float));
+        log->radius = realloc(log->radius, log->position_capacity * sizeof(float));
+        log->asleep = realloc(log->asleep, log->position_capacity * sizeof(uint8_t));
+    }
+    memcpy(log->x, circles->x, circles->count * sizeof(float));
+    memcpy(log->y, circles->y, circles->count * sizeof(float));
+    memcpy(log->radius, circles->radius, circles->count * sizeof(float));
+    memcpy(log->asleep, circles->asleep, circles->count * sizeof(uint8_t));
+
+    log->circle_count = circles->count;
+    log->pair_count = 0;
+}
+
+// a whole batch at a time, so the lock is only taken once per CCOLL_BATCH_SIZE pairs
+void ccoll_pair_log_add(CollisionPairLog* log, const int* first, const int* second, int count)
+{
+    // an empty batch, and the log might not have anything allocated to copy into yet
+    if (count == 0)
+        return;
+
+    pthread_mutex_lock(&log->lock);
+    if (log->pair_count + count > log->pair_capacity)
+    {
+        log->pair_capacity = (log->pair_count + count) * 2;
+        log->first = realloc(log->first, log->pair_capacity * sizeof(int));
+        log->second = realloc(log->second, log->pair_capacity * sizeof(int));
+    }
+    memcpy(&log->first[log->pair_count], first, count * sizeof(int));
+    memcpy(&log->second[log->pair_count], second, count * sizeof(int));
+    log->pair_count += count;
+    pthread_mutex_unlock(&log->lock);
+}
+
+void ccoll_pair_log_destroy(CollisionPairLog* log)
+{
+    if (log)
+    {
+        pthread_mutex_destroy(&log->lock);
+        free(log->first);
+        free(log->second);
+        free(log->x);
+        free(log->y);
+        free(log->radius);
+        free(log->asleep);
+        free(log);
+    }
 }
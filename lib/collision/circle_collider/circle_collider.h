@@ -1,9 +1,65 @@
 #ifndef CIRCLE_COLLIDER_H
 #define CIRCLE_COLLIDER_H
 
+#include <pthread.h>
+#include <stdint.h>
+
+#include "../../circle/circle.h"
 #include "../../spatial_grid/spatial_grid.h"
+#include "../../hashed_grid/hashed_grid.h"
+#include "../../hierarchical_grid/hierarchical_grid.h"
+#include "../../loose_quadtree/loose_quadtree.h"
+#include "../../neighbour_list/neighbour_list.h"
+#include "../../sweep_and_prune/sweep_and_prune.h"
+#include "../../thread_pool/thread_pool.h"
+
+typedef struct
+{
+    int64_t candidate_pairs; // pairs that got a distance test. two sleeping circles aren't a candidate pair, see sleep.h
+    int64_t contacts;        // pairs that were overlapping and got resolved
+} CollisionStats;
+
+// Every candidate pair the collider was handed in one step, and where the circles were when it started,
+// so a broad phase can be checked against a brute-force search over the same positions (see scenarios.c).
+// Only kept when a log is attached with broad_phase_set_pair_log, the collider doesn't touch it otherwise.
+typedef struct
+{
+    pthread_mutex_t lock; // the grid's bands add pairs from several threads at once
+    int pair_count;
+    int pair_capacity;
+    int* first;  // pair i is (first[i], second[i]), store indexes, in whatever order the threads got to them
+    int* second;
+
+    int circle_count; // circles in the store when the step's collisions started
+    int position_capacity;
+    float* x;
+    float* y;
+    float* radius;
+    uint8_t* asleep; // pairs of sleeping circles are never tested, so they aren't expected in the log either
+} CollisionPairLog;
+
+// Resolves every circle-circle collision in the grid.
+// With a pool of more than one thread bands of rows are worked on in parallel, see circle_collider.c.
+// The result is the same whatever the thread count (or without a pool).
+// stats can be NULL if you don't care about the counts.
+// log (usually NULL) gets every candidate pair, see CollisionPairLog.
+// contact_log (usually NULL) only gets the pairs that were overlapping and got resolved, and isn't emptied here.
+void ccoll_rebound_velocity(SpatialGrid* grid, CircleStore* circles, ThreadPool* pool, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log);
+// Same again for circles spread over a HierarchicalGrid. Always runs on the calling thread.
+void ccoll_rebound_velocity_hierarchical(HierarchicalGrid* hgrid, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log);
+// Same again, but only tests the pairs on a neighbour list. Always runs on the calling thread.
+void ccoll_rebound_velocity_pairs(NeighbourList* list, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log);
+// Same again, sweeping the sorted boxes of a SweepAndPrune that's just been updated. Always runs on the calling thread.
+void ccoll_rebound_velocity_sweep(SweepAndPrune* sap, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log);
+// Same again for circles in a LooseQuadtree. Always runs on the calling thread.
+void ccoll_rebound_velocity_quadtree(LooseQuadtree* tree, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log);
+// Same again for circles in a HashedGrid. Always runs on the calling thread.
+void ccoll_rebound_velocity_hashed(HashedGrid* grid, CircleStore* circles, CollisionStats* stats, CollisionPairLog* log, CollisionPairLog* contact_log);
 
-void ccoll_rebound_velocity(SpatialGrid* grid);
+CollisionPairLog* ccoll_pair_log_create(void);
+// Empties the log and copies where the circles are now. Call before the collisions it's meant to record.
+void ccoll_pair_log_begin(CollisionPairLog* log, CircleStore* circles);
+void ccoll_pair_log_destroy(CollisionPairLog* log);
 
 
 #endif
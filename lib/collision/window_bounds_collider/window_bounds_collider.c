@@ -1,57 +1,160 @@
 
 #include "window_bounds_collider.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 
 // private prototypes
-bool wbcoll_will_collide_top(Circle* c);
-bool wbcoll_will_collide_bottom(Circle* c, int window_height);
-bool wbcoll_will_collide_left(Circle* c);
-bool wbcoll_will_collide_right(Circle* c, int window_width);
+void wbcoll_rebound_circle(CircleStore* circles, int i, Window window);
+bool wbcoll_will_collide_top(CircleStore* circles, int i);
+bool wbcoll_will_collide_bottom(CircleStore* circles, int i, int window_height);
+bool wbcoll_will_collide_left(CircleStore* circles, int i);
+bool wbcoll_will_collide_right(CircleStore* circles, int i, int window_width);
+
+
+// Bounces every circle off the four walls.
+// The vector paths do exactly the same float operations in the same order as wbcoll_rebound_circle,
+// just on 8 (AVX2) or 4 (SSE) circles at once, using masks instead of branches.
+void wbcoll_rebound_velocity(CircleStore* circles, Window window)
+{
+    float* x = circles->x;
+    float* y = circles->y;
+    float* vx = circles->vx;
+    float* vy = circles->vy;
+    float* r = circles->radius;
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256 zero = _mm256_setzero_ps();
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 gap = _mm256_set1_ps(0.01f);
+    __m256 width = _mm256_set1_ps((float)window.width);
+    __m256 height = _mm256_set1_ps((float)window.height);
+
+    for (; i + 8 <= circles->count; i += 8)
+    {
+        __m256 px = _mm256_load_ps(&x[i]);
+        __m256 py = _mm256_load_ps(&y[i]);
+        __m256 pvx = _mm256_load_ps(&vx[i]);
+        __m256 pvy = _mm256_load_ps(&vy[i]);
+        __m256 pr = _mm256_load_ps(&r[i]);
+
+        // top
+        __m256 hit = _mm256_cmp_ps(_mm256_sub_ps(py, pr), zero, _CMP_LE_OQ);
+        pvy = _mm256_blendv_ps(pvy, _mm256_xor_ps(pvy, sign), hit);
+        py = _mm256_blendv_ps(py, _mm256_add_ps(pr, gap), hit);
+        // bottom
+        hit = _mm256_cmp_ps(_mm256_add_ps(py, pr), height, _CMP_GE_OQ);
+        pvy = _mm256_blendv_ps(pvy, _mm256_xor_ps(pvy, sign), hit);
+        py = _mm256_blendv_ps(py, _mm256_sub_ps(_mm256_sub_ps(height, pr), gap), hit);
+        // left
+        hit = _mm256_cmp_ps(_mm256_sub_ps(px, pr), zero, _CMP_LE_OQ);
+        pvx = _mm256_blendv_ps(pvx, _mm256_xor_ps(pvx, sign), hit);
+        px = _mm256_blendv_ps(px, _mm256_add_ps(pr, gap), hit);
+        // right
+        hit = _mm256_cmp_ps(_mm256_add_ps(px, pr), width, _CMP_GE_OQ);
+        pvx = _mm256_blendv_ps(pvx, _mm256_xor_ps(pvx, sign), hit);
+        px = _mm256_blendv_ps(px, _mm256_sub_ps(_mm256_sub_ps(width, pr), gap), hit);
 
+        _mm256_store_ps(&x[i], px);
+        _mm256_store_ps(&y[i], py);
+        _mm256_store_ps(&vx[i], pvx);
+        _mm256_store_ps(&vy[i], pvy);
+    }
+#elif defined(__SSE2__)
+    // SSE2 has no blend, so select with and/andnot/or: (mask & a) | (~mask & b)
+#define WBCOLL_SELECT(mask, a, b) _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+    __m128 zero = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 gap = _mm_set1_ps(0.01f);
+    __m128 width = _mm_set1_ps((float)window.width);
+    __m128 height = _mm_set1_ps((float)window.height);
+
+    for (; i + 4 <= circles->count; i += 4)
+    {
+        __m128 px = _mm_load_ps(&x[i]);
+        __m128 py = _mm_load_ps(&y[i]);
+        __m128 pvx = _mm_load_ps(&vx[i]);
+        __m128 pvy = _mm_load_ps(&vy[i]);
+        __m128 pr = _mm_load_ps(&r[i]);
+
+        // top
+        __m128 hit = _mm_cmple_ps(_mm_sub_ps(py, pr), zero);
+        pvy = WBCOLL_SELECT(hit, _mm_xor_ps(pvy, sign), pvy);
+        py = WBCOLL_SELECT(hit, _mm_add_ps(pr, gap), py);
+        // bottom
+        hit = _mm_cmpge_ps(_mm_add_ps(py, pr), height);
+        pvy = WBCOLL_SELECT(hit, _mm_xor_ps(pvy, sign), pvy);
+        py = WBCOLL_SELECT(hit, _mm_sub_ps(_mm_sub_ps(height, pr), gap), py);
+        // left
+        hit = _mm_cmple_ps(_mm_sub_ps(px, pr), zero);
+        pvx = WBCOLL_SELECT(hit, _mm_xor_ps(pvx, sign), pvx);
+        px = WBCOLL_SELECT(hit, _mm_add_ps(pr, gap), px);
+        // right
+        hit = _mm_cmpge_ps(_mm_add_ps(px, pr), width);
+        pvx = WBCOLL_SELECT(hit, _mm_xor_ps(pvx, sign), pvx);
+        px = WBCOLL_SELECT(hit, _mm_sub_ps(_mm_sub_ps(width, pr), gap), px);
+
+        _mm_store_ps(&x[i], px);
+        _mm_store_ps(&y[i], py);
+        _mm_store_ps(&vx[i], pvx);
+        _mm_store_ps(&vy[i], pvy);
+    }
+#undef WBCOLL_SELECT
+#endif
+
+    // whatever didn't fill a whole vector (or everything, without SSE)
+    for (; i < circles->count; i++)
+        wbcoll_rebound_circle(circles, i, window);
+}
 
-void wbcoll_rebound_velocity(Circle* c, Window window)
+void wbcoll_rebound_circle(CircleStore* circles, int i, Window window)
 {
-    if(wbcoll_will_collide_top(c))
+    if(wbcoll_will_collide_top(circles, i))
     {
-        c->velocity[1] = -c->velocity[1];
-        c->position[1] = c->radius + 0.01f;
+        circles->vy[i] = -circles->vy[i];
+        circles->y[i] = circles->radius[i] + 0.01f;
     }
-    if(wbcoll_will_collide_bottom(c, window.height))
+    if(wbcoll_will_collide_bottom(circles, i, window.height))
     {
-        c->velocity[1] = -c->velocity[1];
-        c->position[1] = window.height - c->radius - 0.01f;
+        circles->vy[i] = -circles->vy[i];
+        circles->y[i] = window.height - circles->radius[i] - 0.01f;
     }
 
 
-    if (wbcoll_will_collide_left(c))
+    if (wbcoll_will_collide_left(circles, i))
     {
-        c->velocity[0] = -c->velocity[0];
-        c->position[0] = c->radius + 0.01f;
+        circles->vx[i] = -circles->vx[i];
+        circles->x[i] = circles->radius[i] + 0.01f;
     }
-    if(wbcoll_will_collide_right(c, window.width))
+    if(wbcoll_will_collide_right(circles, i, window.width))
     {
-        c->velocity[0] = -c->velocity[0];
-        c->position[0] = window.width - c->radius - 0.01f;
+        circles->vx[i] = -circles->vx[i];
+        circles->x[i] = window.width - circles->radius[i] - 0.01f;
     }
         
 }
 
-bool wbcoll_will_collide_top(Circle* c)
+bool wbcoll_will_collide_top(CircleStore* circles, int i)
 {
-    return (c->position[1] - c->radius) <= 0;
+    return (circles->y[i] - circles->radius[i]) <= 0;
 }
 
-bool wbcoll_will_collide_bottom(Circle* c, int window_height)
+bool wbcoll_will_collide_bottom(CircleStore* circles, int i, int window_height)
 {
-    return (c->position[1] + c->radius) >= window_height;
+    return (circles->y[i] + circles->radius[i]) >= window_height;
 }
 
-bool wbcoll_will_collide_left(Circle* c)
+bool wbcoll_will_collide_left(CircleStore* circles, int i)
 {
-    return (c->position[0] - c->radius) <= 0;
+    return (circles->x[i] - circles->radius[i]) <= 0;
 }
 
-bool wbcoll_will_collide_right(Circle* c, int window_width)
+bool wbcoll_will_collide_right(CircleStore* circles, int i, int window_width)
 {
-    return (c->position[0] + c->radius) >= window_width;
+    return (circles->x[i] + circles->radius[i]) >= window_width;
 }
@@ -4,6 +4,6 @@
 #include "../../circle/circle.h"
 #include "../../window/window.h"
 
-void wbcoll_rebound_velocity(Circle* c, Window window);
+void wbcoll_rebound_velocity(CircleStore* circles, Window window);
 
 #endif
@@ -0,0 +1,242 @@
+#include "hashed_grid.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// private prototypes
+int64_t hashed_grid_key(int row, int col);
+int hashed_grid_find(HashedGrid* grid, int64_t key);
+int hashed_grid_find_or_add(HashedGrid* grid, int64_t key);
+void hashed_grid_grow(HashedGrid* grid, int capacity);
+void hashed_grid_reserve(HashedGrid* grid, int circle_count);
+
+HashedGrid* hashed_grid_create(int circle_count, int cell_size, int reach)
+{
+    HashedGrid* grid = malloc(sizeof(HashedGrid));
+    memset(grid, 0, sizeof(HashedGrid));
+
+    hashed_grid_resize(grid, cell_size, reach);
+    hashed_grid_reserve(grid, circle_count);
+    return grid;
+}
+
+void hashed_grid_resize(HashedGrid* grid, int cell_size, int reach)
+{
+    if (cell_size < 1)
+        cell_size = 1;
+    if (reach < 1)
+        reach = 1;
+    if (reach > GRID_MAX_REACH)
+        reach = GRID_MAX_REACH;
+
+    grid->cell_size = cell_size;
+    grid->reach = reach;
+    hashed_grid_clear(grid);
+}
+
+void hashed_grid_clear(HashedGrid* grid)
+{
+    // everything with an older stamp counts as empty. on the (very) rare wrap around, really empty the table.
+    grid->stamp++;
+    if (grid->stamp == 0x7fffffff)
+    {
+        for (int slot = 0; slot < grid->capacity; slot++)
+            grid->cells[slot].stamp = 0;
+        grid->stamp = 1;
+    }
+
+    grid->used_count = 0;
+    grid->inserted = 0;
+    grid->sorted = false;
+}
+
+// Make sure the per-circle arrays can hold circle_count circles, and the table can hold that many cells at no more than half full.
+void hashed_grid_reserve(HashedGrid* grid, int circle_count)
+{
+    if (circle_count > grid->circle_capacity)
+    {
+        grid->circle_capacity = circle_count;
+        grid->pending = realloc(grid->pending, circle_count * sizeof(int));
+        grid->pending_slot = realloc(grid->pending_slot, circle_count * sizeof(int));
+        grid->circles = realloc(grid->circles, circle_count * sizeof(int));
+        grid->used = realloc(grid->used, circle_count * sizeof(int));
+    }
+
+    int capacity = 64;
+    while (capacity < circle_count * 2)
+        capacity *= 2;
+    if (capacity > grid->capacity)
+        hashed_grid_grow(grid, capacity);
+}
+
+void hashed_grid_grow(HashedGrid* grid, int capacity)
+{
+    HashedCell* old_cells = grid->cells;
+
+    grid->cells = calloc(capacity, sizeof(HashedCell));
+    grid->capacity = capacity;
+
+    // move the cells that are in use over. the stamps still match, so nothing inserted so far is lost
+    for (int i = 0; i < grid->used_count; i++)
+    {
+        HashedCell* cell = &old_cells[grid->used[i]];
+        int slot = hashed_grid_find_or_add(grid, cell->key);
+        grid->cells[slot].count = cell->count;
+        grid->used[i] = slot;
+    }
+
+    // the pending circles point at old slots, point them at the new ones
+    for (int i = 0; i < grid->inserted; i++)
+        grid->pending_slot[i] = hashed_grid_find(grid, old_cells[grid->pending_slot[i]].key);
+
+    free(old_cells);
+}
+
+// row and column are 32 bits each, which covers any world a float position can describe
+int64_t hashed_grid_key(int row, int col)
+{
+    return (int64_t)(((uint64_t)(uint32_t)row << 32) | (uint32_t)col);
+}
+
+// Returns the slot holding key, or -1 if it isn't in use.
+int hashed_grid_find(HashedGrid* grid, int64_t key)
+{
+    // multiply by a big odd constant and keep the top bits, neighbouring cells end up far apart in the table
+    uint64_t hash = (uint64_t)key * 0x9E3779B97F4A7C15ull;
+    int mask = grid->capacity - 1;
+    int slot = (int)(hash >> 32) & mask;
+
+    // linear probing. the table is never more than half full, so this ends quickly
+    while (grid->cells[slot].stamp == grid->stamp)
+    {
+        if (grid->cells[slot].key == key)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+int hashed_grid_find_or_add(HashedGrid* grid, int64_t key)
+{
+    uint64_t hash = (uint64_t)key * 0x9E3779B97F4A7C15ull;
+    int mask = grid->capacity - 1;
+    int slot = (int)(hash >> 32) & mask;
+
+    while (grid->cells[slot].stamp == grid->stamp)
+    {
+        if (grid->cells[slot].key == key)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+
+    HashedCell* cell = &grid->cells[slot];
+    cell->key = key;
+    cell->stamp = grid->stamp;
+    cell->count = 0;
+    return slot;
+}
+
+void hashed_grid_insert(HashedGrid* grid, int circle, float x, float y)
+{
+    if (grid->inserted == grid->circle_capacity)
+        hashed_grid_reserve(grid, grid->circle_capacity * 2 + 1);
+
+    int row = (int)floorf(y / grid->cell_size);
+    int col = (int)floorf(x / grid->cell_size);
+    int slot = hashed_grid_find_or_add(grid, hashed_grid_key(row, col));
+
+    HashedCell* cell = &grid->cells[slot];
+    if (cell->count == 0)
+        grid->used[grid->used_count++] = slot;
+    cell->count++;
+
+    grid->pending[grid->inserted] = circle;
+    grid->pending_slot[grid->inserted] = slot;
+    grid->inserted++;
+    grid->sorted = false;
+}
+
+// Counting sort of the pending circles by cell, the same as grid_sort but only over the cells in use.
+void hashed_grid_sort(HashedGrid* grid)
+{
+    if (grid->sorted)
+        return;
+
+    int offset = 0;
+    for (int i = 0; i < grid->used_count; i++)
+    {
+        HashedCell* cell = &grid->cells[grid->used[i]];
+        cell->start = offset;
+        offset += cell->count;
+    }
+
+    // start doubles as a write cursor, then gets wound back once everything is in
+    for (int i = 0; i < grid->inserted; i++)
+        grid->circles[grid->cells[grid->pending_slot[i]].start++] = grid->pending[i];
+    for (int i = 0; i < grid->used_count; i++)
+        grid->cells[grid->used[i]].start -= grid->cells[grid->used[i]].count;
+
+    grid->sorted = true;
+}
+
+CircleSpan hashed_grid_get_used_cell(HashedGrid* grid, int index, int* row, int* col)
+{
+    hashed_grid_sort(grid);
+
+    HashedCell* cell = &grid->cells[grid->used[index]];
+    *row = (int)(cell->key >> 32);
+    *col = (int)(int32_t)(uint32_t)cell->key;
+
+    CircleSpan span;
+    span.begin = &grid->circles[cell->start];
+    span.end = span.begin + cell->count;
+    return span;
+}
+
+void hashed_grid_get_neighbourhood(HashedGrid* grid, int row, int col, HashedNeighbourhood* out)
+{
+    out->span_count = 0;
+
+    hashed_grid_sort(grid);
+
+    for (int check_row = row - grid->reach; check_row <= row + grid->reach; check_row++)
+    {
+        for (int check_col = col - grid->reach; check_col <= col + grid->reach; check_col++)
+        {
+            int slot = hashed_grid_find(grid, hashed_grid_key(check_row, check_col));
+            if (slot < 0)
+                continue;
+
+            HashedCell* cell = &grid->cells[slot];
+            out->spans[out->span_count].begin = &grid->circles[cell->start];
+            out->spans[out->span_count].end = &grid->circles[cell->start + cell->count];
+            out->span_count++;
+        }
+    }
+}
+
+void hashed_grid_get_occupancy(HashedGrid* grid, int* occupied_cells, int* max_occupancy)
+{
+    *occupied_cells = grid->used_count;
+    *max_occupancy = 0;
+
+    for (int i = 0; i < grid->used_count; i++)
+    {
+        if (grid->cells[grid->used[i]].count > *max_occupancy)
+            *max_occupancy = grid->cells[grid->used[i]].count;
+    }
+}
+
+void hashed_grid_destroy(HashedGrid* grid)
+{
+    if (grid)
+    {
+        free(grid->cells);
+        free(grid->used);
+        free(grid->pending);
+        free(grid->pending_slot);
+        free(grid->circles);
+        free(grid);
+    }
+}
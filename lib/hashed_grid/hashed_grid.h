@@ -0,0 +1,67 @@
+#ifndef HASHED_GRID_H
+#define HASHED_GRID_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../spatial_grid/spatial_grid.h"
+
+// One cell of the hash table. It only counts as being in use this step if stamp matches HashedGrid.stamp.
+typedef struct
+{
+    int64_t key; // row and column packed together, see hashed_grid.c
+    int stamp;
+    int count;   // circles in the cell
+    int start;   // offset of the cell in HashedGrid.circles, once sorted
+} HashedCell;
+
+// Every circle in a (2 * reach + 1) square block of cells. Cells in a hash table aren't next to each other,
+// so unlike GridNeighbourhood this is one span per cell rather than per row.
+typedef struct
+{
+    CircleSpan spans[(2 * GRID_MAX_REACH + 1) * (2 * GRID_MAX_REACH + 1)];
+    int span_count;
+} HashedNeighbourhood;
+
+// A grid with no edges. Only cells with something in them exist, as entries in an open-addressing hash table
+// keyed by (row, column), so memory follows the number of circles instead of the size of the world,
+// and circles way outside the world get their own cells instead of piling into the edge ones.
+// Clearing just bumps stamp, which empties every cell at once without touching them.
+// Inserting and sorting work like SpatialGrid: insert records the cell and the first query counting-sorts
+// the circles so each cell is one contiguous run.
+typedef struct
+{
+    int cell_size;
+    int reach; // cells searched either side, see GRID_MAX_REACH
+
+    int capacity;      // slots in the table, a power of two at least twice the circles inserted
+    HashedCell* cells;
+    int stamp;
+
+    int used_count;    // cells in use since the last clear
+    int* used;         // their slots, in the order they were first used
+
+    int inserted;
+    bool sorted;
+    int circle_capacity;
+    int* pending;      // circle indexes in insertion order
+    int* pending_slot; // table slot for each pending circle
+    int* circles;      // inserted circle indexes, sorted by cell
+} HashedGrid;
+
+HashedGrid* hashed_grid_create(int circle_count, int cell_size, int reach);
+// Changes the cell size. Empties the grid.
+void hashed_grid_resize(HashedGrid* grid, int cell_size, int reach);
+void hashed_grid_clear(HashedGrid* grid);
+void hashed_grid_insert(HashedGrid* grid, int circle, float x, float y);
+// Sorts everything inserted since the last sort into its cell. Queries do this for you.
+void hashed_grid_sort(HashedGrid* grid);
+// The circles in the cell in table slot used[index], and which cell that is.
+CircleSpan hashed_grid_get_used_cell(HashedGrid* grid, int index, int* row, int* col);
+// Points out at the circles within grid->reach cells of (row, col). Valid until the next clear or insert.
+void hashed_grid_get_neighbourhood(HashedGrid* grid, int row, int col, HashedNeighbourhood* out);
+// How many cells have anything in them, and the most circles in any one cell. Only walks the used cells.
+void hashed_grid_get_occupancy(HashedGrid* grid, int* occupied_cells, int* max_occupancy);
+void hashed_grid_destroy(HashedGrid* grid);
+
+#endif
@@ -0,0 +1,117 @@
+#include "hierarchical_grid.h"
+#include <math.h>
+#include <stdlib.h>
+
+HierarchicalGrid* hgrid_create(const float* radius, int count, int world_w, int world_h)
+{
+    HierarchicalGrid* hgrid = malloc(sizeof(HierarchicalGrid));
+    hgrid->level_count = 0;
+    hgrid_fit(hgrid, radius, count, world_w, world_h);
+    return hgrid;
+}
+
+void hgrid_fit(HierarchicalGrid* hgrid, const float* radius, int count, int world_w, int world_h)
+{
+    float min_radius = count > 0 ? radius[0] : 1.0f;
+    float max_radius = min_radius;
+    for (int i = 1; i < count; i++)
+    {
+        if (radius[i] < min_radius)
+            min_radius = radius[i];
+        if (radius[i] > max_radius)
+            max_radius = radius[i];
+    }
+
+    int min_diameter = (int)ceilf(min_radius * 2.0f);
+    int max_diameter = (int)ceilf(max_radius * 2.0f);
+    if (min_diameter < 1)
+        min_diameter = 1;
+    if (max_diameter < min_diameter)
+        max_diameter = min_diameter;
+
+    // level 0 has to fit the smallest circles, but there's no point going much below the
+    // average spacing between circles, that just makes lots of empty cells.
+    // in a sparse world that can be bigger than every circle, and then one level is all it takes.
+    int spacing = count > 0 ? (int)sqrt((double)world_w * world_h / count) : max_diameter;
+    int base = min_diameter > spacing ? min_diameter : spacing;
+
+    int level_count = 1;
+    while ((base << (level_count - 1)) < max_diameter && level_count < HGRID_MAX_LEVELS)
+        level_count++;
+
+    // the top level has to fit the biggest circle, even if we ran out of levels getting there
+    if ((base << (level_count - 1)) < max_diameter)
+        base = (max_diameter + (1 << (level_count - 1)) - 1) >> (level_count - 1);
+
+    for (int level = 0; level < level_count; level++)
+    {
+        int cell = base << level;
+        if (level < hgrid->level_count)
+            grid_resize(hgrid->levels[level], world_w, world_h, cell, cell, 1);
+        else
+            hgrid->levels[level] = grid_create(0, world_w, world_h, cell, cell, 1);
+        hgrid->level_population[level] = 0;
+    }
+    for (int level = level_count; level < hgrid->level_count; level++)
+        grid_destroy(hgrid->levels[level]);
+
+    hgrid->level_count = level_count;
+    hgrid->base_cell_size = base;
+    hgrid->world_width = world_w;
+    hgrid->world_height = world_h;
+}
+
+void hgrid_clear(HierarchicalGrid* hgrid)
+{
+    for (int level = 0; level < hgrid->level_count; level++)
+    {
+        // an empty level was never touched, so there's nothing to clear
+        if (hgrid->level_population[level] > 0)
+            grid_clear(hgrid->levels[level]);
+        hgrid->level_population[level] = 0;
+    }
+}
+
+int hgrid_level_for(HierarchicalGrid* hgrid, float radius)
+{
+    float diameter = radius * 2.0f;
+    int level = 0;
+    while (level < hgrid->level_count - 1 && (hgrid->base_cell_size << level) < diameter)
+        level++;
+    return level;
+}
+
+void hgrid_insert(HierarchicalGrid* hgrid, int circle, float x, float y, float radius)
+{
+    int level = hgrid_level_for(hgrid, radius);
+    grid_insert(hgrid->levels[level], circle, x, y);
+    hgrid->level_population[level]++;
+}
+
+void hgrid_get_occupancy(HierarchicalGrid* hgrid, int* occupied_cells, int* max_occupancy)
+{
+    *occupied_cells = 0;
+    *max_occupancy = 0;
+
+    for (int level = 0; level < hgrid->level_count; level++)
+    {
+        if (hgrid->level_population[level] == 0)
+            continue;
+
+        int occupied, max;
+        grid_get_occupancy(hgrid->levels[level], &occupied, &max);
+        *occupied_cells += occupied;
+        if (max > *max_occupancy)
+            *max_occupancy = max;
+    }
+}
+
+void hgrid_destroy(HierarchicalGrid* hgrid)
+{
+    if (hgrid)
+    {
+        for (int level = 0; level < hgrid->level_count; level++)
+            grid_destroy(hgrid->levels[level]);
+        free(hgrid);
+    }
+}
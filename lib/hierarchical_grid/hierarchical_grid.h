@@ -0,0 +1,36 @@
+#ifndef HIERARCHICAL_GRID_H
+#define HIERARCHICAL_GRID_H
+
+#include "../spatial_grid/spatial_grid.h"
+
+#define HGRID_MAX_LEVELS 16
+
+// A stack of SpatialGrids whose cell sizes double from one level to the next.
+// Each circle goes into the first level whose cells are at least as wide as it is,
+// so small circles sit in small cells and a few big ones can't blow the cell size up for everyone.
+//
+// Two circles on the same level can only touch if they're in neighbouring cells, same as a normal grid.
+// A circle can only touch a bigger one if it's in the 3x3 block around its own position on the bigger one's level,
+// so every pair is found by looking at your own level and every coarser level, never finer ones.
+typedef struct
+{
+    int level_count;
+    int base_cell_size; // cell size of level 0, level n is base_cell_size << n
+    int world_width;
+    int world_height;
+    SpatialGrid* levels[HGRID_MAX_LEVELS];
+    int level_population[HGRID_MAX_LEVELS]; // circles inserted into each level since the last clear
+} HierarchicalGrid;
+
+// Works out the levels from the radius spread and density of these circles.
+HierarchicalGrid* hgrid_create(const float* radius, int count, int world_w, int world_h);
+// Picks the levels again, e.g. when the world or population changes. Empties every level.
+void hgrid_fit(HierarchicalGrid* hgrid, const float* radius, int count, int world_w, int world_h);
+void hgrid_clear(HierarchicalGrid* hgrid);
+void hgrid_insert(HierarchicalGrid* hgrid, int circle, float x, float y, float radius);
+int hgrid_level_for(HierarchicalGrid* hgrid, float radius);
+// Same as grid_get_occupancy, over every level.
+void hgrid_get_occupancy(HierarchicalGrid* hgrid, int* occupied_cells, int* max_occupancy);
+void hgrid_destroy(HierarchicalGrid* hgrid);
+
+#endif
@@ -0,0 +1,205 @@
+#include "loose_quadtree.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// private prototypes
+int quadtree_add_node(LooseQuadtree* tree, int parent, float centre_x, float centre_y, float half_size);
+
+LooseQuadtree* quadtree_create(CircleStore* circles, int world_w, int world_h)
+{
+    LooseQuadtree* tree = malloc(sizeof(LooseQuadtree));
+    tree->node_count = 0;
+    tree->node_capacity = 0;
+    tree->nodes = NULL;
+    tree->inserted = 0;
+    tree->sorted = true;
+    tree->circle_capacity = 0;
+    tree->pending = NULL;
+    tree->pending_node = NULL;
+    tree->circles = NULL;
+    tree->sorted_x = NULL;
+    tree->sorted_y = NULL;
+
+    quadtree_fit(tree, circles, world_w, world_h);
+    return tree;
+}
+
+void quadtree_fit(LooseQuadtree* tree, CircleStore* circles, int world_w, int world_h)
+{
+    tree->world_width = world_w;
+    tree->world_height = world_h;
+
+    // keep splitting until a square is about the size of the average gap between circles.
+    // below that most squares would hold one circle or none, and the extra levels are just more nodes to walk.
+    float root_size = world_w > world_h ? world_w : world_h;
+    float spacing = circles->count > 0 ? sqrtf((float)world_w * world_h / circles->count) : root_size;
+
+    tree->max_depth = 0;
+    while (tree->max_depth < QUADTREE_MAX_DEPTH && root_size / (1 << (tree->max_depth + 1)) >= spacing)
+        tree->max_depth++;
+
+    quadtree_clear(tree);
+}
+
+void quadtree_clear(LooseQuadtree* tree)
+{
+    // the root is square, so it covers the longer side of the world
+    float root_half = (tree->world_width > tree->world_height ? tree->world_width : tree->world_height) * 0.5f;
+
+    tree->node_count = 0;
+    quadtree_add_node(tree, -1, root_half, root_half, root_half);
+
+    tree->inserted = 0;
+    tree->sorted = false;
+}
+
+int quadtree_add_node(LooseQuadtree* tree, int parent, float centre_x, float centre_y, float half_size)
+{
+    if (tree->node_count == tree->node_capacity)
+    {
+        tree->node_capacity = tree->node_capacity * 2 + 64;
+        tree->nodes = realloc(tree->nodes, tree->node_capacity * sizeof(QuadtreeNode));
+    }
+
+    QuadtreeNode* node = &tree->nodes[tree->node_count];
+    node->centre_x = centre_x;
+    node->centre_y = centre_y;
+    node->half_size = half_size;
+    node->parent = parent;
+    node->children[0] = node->children[1] = node->children[2] = node->children[3] = -1;
+    node->start = 0;
+    node->count = 0;
+    return tree->node_count++;
+}
+
+void quadtree_insert(LooseQuadtree* tree, CircleStore* circles, int circle)
+{
+    if (tree->inserted == tree->circle_capacity)
+    {
+        tree->circle_capacity = circles->capacity > tree->circle_capacity ? circles->capacity : tree->circle_capacity * 2 + 1;
+        tree->pending = realloc(tree->pending, tree->circle_capacity * sizeof(int));
+        tree->pending_node = realloc(tree->pending_node, tree->circle_capacity * sizeof(int));
+        tree->circles = realloc(tree->circles, tree->circle_capacity * sizeof(int));
+        tree->sorted_x = realloc(tree->sorted_x, tree->circle_capacity * sizeof(float));
+        tree->sorted_y = realloc(tree->sorted_y, tree->circle_capacity * sizeof(float));
+    }
+
+    float x = circles->x[circle];
+    float y = circles->y[circle];
+    float radius = circles->radius[circle];
+    int node = 0;
+
+    // outside the world there's no square that loosely holds it, so it stays in the root
+    bool inside = x >= 0.0f && y >= 0.0f && x < tree->nodes[0].half_size * 2.0f && y < tree->nodes[0].half_size * 2.0f;
+
+    for (int depth = 0; inside && depth < tree->max_depth; depth++)
+    {
+        QuadtreeNode* parent = &tree->nodes[node];
+        float child_half = parent->half_size * 0.5f;
+
+        // too big for the next level down
+        if (radius > child_half)
+            break;
+
+        int quadrant = (x >= parent->centre_x) + 2 * (y >= parent->centre_y);
+        int child = parent->children[quadrant];
+        if (child < 0)
+        {
+            float child_x = parent->centre_x + (x >= parent->centre_x ? child_half : -child_half);
+            float child_y = parent->centre_y + (y >= parent->centre_y ? child_half : -child_half);
+
+            // adding a node can move the array, so don't hold on to parent past this
+            child = quadtree_add_node(tree, node, child_x, child_y, child_half);
+            tree->nodes[node].children[quadrant] = child;
+        }
+        node = child;
+    }
+
+    tree->pending[tree->inserted] = circle;
+    tree->pending_node[tree->inserted] = node;
+    tree->inserted++;
+    tree->nodes[node].count++;
+    tree->sorted = false;
+}
+
+// Counting sort of the pending circles by node, same as grid_sort, then the boxes from the bottom up.
+void quadtree_sort(LooseQuadtree* tree, CircleStore* circles)
+{
+    if (tree->sorted)
+        return;
+
+    int offset = 0;
+    for (int node = 0; node < tree->node_count; node++)
+    {
+        tree->nodes[node].start = offset;
+        offset += tree->nodes[node].count;
+    }
+
+    // start doubles as a write cursor, then gets wound back once everything is in
+    for (int i = 0; i < tree->inserted; i++)
+        tree->circles[tree->nodes[tree->pending_node[i]].start++] = tree->pending[i];
+    for (int node = 0; node < tree->node_count; node++)
+        tree->nodes[node].start -= tree->nodes[node].count;
+
+    for (int node = 0; node < tree->node_count; node++)
+    {
+        QuadtreeNode* n = &tree->nodes[node];
+        n->min_x = n->min_y = INFINITY;
+        n->max_x = n->max_y = -INFINITY;
+
+        for (int i = n->start; i < n->start + n->count; i++)
+        {
+            int c = tree->circles[i];
+            float radius = circles->radius[c];
+            tree->sorted_x[i] = circles->x[c];
+            tree->sorted_y[i] = circles->y[c];
+            n->min_x = fminf(n->min_x, tree->sorted_x[i] - radius);
+            n->max_x = fmaxf(n->max_x, tree->sorted_x[i] + radius);
+            n->min_y = fminf(n->min_y, tree->sorted_y[i] - radius);
+            n->max_y = fmaxf(n->max_y, tree->sorted_y[i] + radius);
+        }
+    }
+
+    // children are always added after their parent, so going backwards finishes every child before its parent
+    for (int node = tree->node_count - 1; node > 0; node--)
+    {
+        QuadtreeNode* n = &tree->nodes[node];
+        QuadtreeNode* parent = &tree->nodes[n->parent];
+        parent->min_x = fminf(parent->min_x, n->min_x);
+        parent->max_x = fmaxf(parent->max_x, n->max_x);
+        parent->min_y = fminf(parent->min_y, n->min_y);
+        parent->max_y = fmaxf(parent->max_y, n->max_y);
+    }
+
+    tree->sorted = true;
+}
+
+void quadtree_get_occupancy(LooseQuadtree* tree, int* occupied_nodes, int* max_occupancy)
+{
+    *occupied_nodes = 0;
+    *max_occupancy = 0;
+
+    for (int node = 0; node < tree->node_count; node++)
+    {
+        int count = tree->nodes[node].count;
+        if (count > 0)
+            (*occupied_nodes)++;
+        if (count > *max_occupancy)
+            *max_occupancy = count;
+    }
+}
+
+void quadtree_destroy(LooseQuadtree* tree)
+{
+    if (tree)
+    {
+        free(tree->nodes);
+        free(tree->pending);
+        free(tree->pending_node);
+        free(tree->circles);
+        free(tree->sorted_x);
+        free(tree->sorted_y);
+        free(tree);
+    }
+}
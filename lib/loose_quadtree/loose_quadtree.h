@@ -0,0 +1,67 @@
+#ifndef LOOSE_QUADTREE_H
+#define LOOSE_QUADTREE_H
+
+#include <stdbool.h>
+
+#include "../circle/circle.h"
+
+#define QUADTREE_MAX_DEPTH 12
+
+// One square of the tree. Its loose bounds are twice its size, centre +- 2 * half_size, so a circle
+// whose centre is inside the square and whose radius is at most half_size always fits inside them.
+// Those decide where a circle goes. Queries use the tighter box around what's actually in the node and below it.
+typedef struct
+{
+    float centre_x;
+    float centre_y;
+    float half_size;
+    int parent;
+    int children[4]; // node indexes, -1 where nothing has been inserted yet
+    int start;       // offset of this node's circles in LooseQuadtree.circles, once sorted
+    int count;
+    float min_x;     // box around every circle in this node and the nodes below it, once sorted
+    float max_x;
+    float min_y;
+    float max_y;
+} QuadtreeNode;
+
+// A loose quadtree, rebuilt every step. Each circle goes down from the root to the smallest square
+// it still fits in loosely (or max_depth, whichever comes first), and only the squares something went through exist,
+// so empty parts of the world cost nothing. That's what makes it worth having next to the grid:
+// clustered or mostly empty worlds waste most of a grid's cells, but not tree nodes.
+// Circles whose centre is outside the world stay in the root, which every query looks at.
+// Like the grid, inserting only records which node a circle belongs in, and the first query sorts
+// them so each node's circles sit next to each other in one array.
+typedef struct
+{
+    float world_width;
+    float world_height;
+    int max_depth; // picked by quadtree_fit so the deepest squares hold about one circle each
+
+    int node_count;
+    int node_capacity;
+    QuadtreeNode* nodes; // nodes[0] is the root
+
+    int inserted;
+    bool sorted;
+    int circle_capacity;
+    int* pending;      // circle indexes in insertion order
+    int* pending_node; // node index for each pending circle
+    int* circles;      // inserted circle indexes, sorted by node
+    float* sorted_x;   // where each of circles was when it was sorted. the boxes are built from these,
+    float* sorted_y;   // so queries have to use them too: the collider moves circles while it's still querying
+} LooseQuadtree;
+
+LooseQuadtree* quadtree_create(CircleStore* circles, int world_w, int world_h);
+// Picks the depth for this population and world. Empties the tree.
+void quadtree_fit(LooseQuadtree* tree, CircleStore* circles, int world_w, int world_h);
+void quadtree_clear(LooseQuadtree* tree);
+void quadtree_insert(LooseQuadtree* tree, CircleStore* circles, int circle);
+// Sorts everything inserted since the last sort into its node and works out every node's box.
+// Call before reading a node's circles or box.
+void quadtree_sort(LooseQuadtree* tree, CircleStore* circles);
+// How many nodes hold circles, and the most circles in any one node. Walks every node.
+void quadtree_get_occupancy(LooseQuadtree* tree, int* occupied_nodes, int* max_occupancy);
+void quadtree_destroy(LooseQuadtree* tree);
+
+#endif
@@ -0,0 +1,140 @@
+#include "neighbour_list.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// private prototypes
+void nlist_add_pair(NeighbourList* list, int c1, int c2);
+
+NeighbourList* nlist_create(float skin)
+{
+    NeighbourList* list = malloc(sizeof(NeighbourList));
+    memset(list, 0, sizeof(NeighbourList));
+    list->skin = skin;
+    list->built_count = -1;
+    return list;
+}
+
+bool nlist_needs_rebuild(NeighbourList* list, CircleStore* circles)
+{
+    list->steps++;
+
+    if (list->built_count != circles->count || list->built_version != circles->layout_version)
+        return true;
+
+    // a gap can only close by as much as the two circles either side of it have moved,
+    // so the list is good until the two biggest moves add up to more than the skin.
+    // track them squared and only take the two square roots at the end.
+    float largest = 0.0f;
+    float second = 0.0f;
+    float skin_squared = list->skin * list->skin;
+
+    for (int i = 0; i < circles->count; i++)
+    {
+        float dx = circles->x[i] - list->built_x[i];
+        float dy = circles->y[i] - list->built_y[i];
+        float moved = dx * dx + dy * dy;
+
+        if (moved > second)
+        {
+            if (moved > largest)
+            {
+                second = largest;
+                largest = moved;
+            }
+            else
+                second = moved;
+
+            // one circle has gone the whole skin on its own, no need to look any further
+            if (largest > skin_squared)
+                return true;
+        }
+    }
+
+    return sqrtf(largest) + sqrtf(second) > list->skin;
+}
+
+void nlist_build(NeighbourList* list, SpatialGrid* grid, CircleStore* circles)
+{
+    list->pair_count = 0;
+
+    // walk the grid the same way the collider does, so the pairs come out in the same order
+    for (int row = 0; row < grid->rows; row++)
+    {
+        for (int col = 0; col < grid->columns; col++)
+        {
+            CircleSpan cell = grid_get_cell(grid, row, col);
+            if (cell.begin == cell.end)
+                continue;
+
+            GridNeighbourhood nearby;
+            grid_get_neighbourhood(grid, row, col, &nearby);
+
+            for (int* c = cell.begin; c != cell.end; c++)
+            {
+                int c1 = *c;
+                for (int span = 0; span < nearby.span_count; span++)
+                {
+                    for (int* current = nearby.spans[span].begin; current != nearby.spans[span].end; current++)
+                    {
+                        int c2 = *current;
+                        if (c1 >= c2) // prevent duplicate and self pairs
+                            continue;
+
+                        float dx = circles->x[c2] - circles->x[c1];
+                        float dy = circles->y[c2] - circles->y[c1];
+                        float reach = circles->radius[c1] + circles->radius[c2] + list->skin;
+                        if (dx * dx + dy * dy < reach * reach)
+                            nlist_add_pair(list, c1, c2);
+                    }
+                }
+            }
+        }
+    }
+
+    // remember where everything was, nlist_needs_rebuild measures from here
+    if (circles->count > list->position_capacity)
+    {
+        list->position_capacity = circles->count;
+        list->built_x = realloc(list->built_x, list->position_capacity * sizeof(float));
+        list->built_y = realloc(list->built_y, list->position_capacity * sizeof(float));
+    }
+    memcpy(list->built_x, circles->x, circles->count * sizeof(float));
+    memcpy(list->built_y, circles->y, circles->count * sizeof(float));
+
+    list->built_count = circles->count;
+    list->built_version = circles->layout_version;
+    list->builds++;
+}
+
+void nlist_add_pair(NeighbourList* list, int c1, int c2)
+{
+    if (list->pair_count == list->pair_capacity)
+    {
+        list->pair_capacity = list->pair_capacity * 2 + 64;
+        list->first = realloc(list->first, list->pair_capacity * sizeof(int));
+        list->second = realloc(list->second, list->pair_capacity * sizeof(int));
+    }
+
+    list->first[list->pair_count] = c1;
+    list->second[list->pair_count] = c2;
+    list->pair_count++;
+}
+
+void nlist_invalidate(NeighbourList* list)
+{
+    list->built_count = -1;
+}
+
+void nlist_destroy(NeighbourList* list)
+{
+    if (list)
+    {
+        free(list->first);
+        free(list->second);
+        free(list->built_x);
+        free(list->built_y);
+        free(list);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef NEIGHBOUR_LIST_H
+#define NEIGHBOUR_LIST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../circle/circle.h"
+#include "../spatial_grid/spatial_grid.h"
+
+// A cached list of every pair of circles that are within skin pixels of touching (a Verlet list).
+// While no two circles have moved more than the skin between them since the list was built, no two circles
+// that weren't on the list can have closed the gap between them, so the collider only has to test the list
+// and the grid only has to be rebuilt every few steps instead of every step.
+// Pairs hold store indexes, so the list is rebuilt whenever the store's layout_version changes.
+typedef struct
+{
+    float skin;
+
+    int pair_count;
+    int pair_capacity;
+    int* first;  // pair i is (first[i], second[i]), in the order the grid found them
+    int* second;
+
+    int built_count;   // circles in the store when the list was built, -1 if it has to be rebuilt
+    int64_t built_version; // the store's layout_version when the list was built
+    int position_capacity;
+    float* built_x;    // where each circle was when the list was built
+    float* built_y;
+
+    int64_t builds;    // times the list has been built
+    int64_t steps;     // times nlist_needs_rebuild has been asked
+} NeighbourList;
+
+NeighbourList* nlist_create(float skin);
+// True if circles were added, removed or moved around in the store, the list was invalidated, or the two circles that have moved furthest
+// since the last build have gone more than skin between them.
+bool nlist_needs_rebuild(NeighbourList* list, CircleStore* circles);
+// Rebuilds the pairs from a grid that every circle has just been inserted into.
+// The grid's reach has to cover the biggest diameter plus the skin (see grid_choose_cell_size's margin).
+void nlist_build(NeighbourList* list, SpatialGrid* grid, CircleStore* circles);
+void nlist_invalidate(NeighbourList* list);
+void nlist_destroy(NeighbourList* list);
+
+#endif
@@ -0,0 +1,136 @@
+#include "perf_counters.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* perf_counter_names[PERF_COUNTER_COUNT] = {
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+};
+
+#if defined(__linux__)
+
+// private prototypes
+int perf_counters_open(PerfCounter counter, int group);
+
+PerfCounters* perf_counters_create(void)
+{
+    PerfCounters* counters = malloc(sizeof(PerfCounters));
+    memset(counters, 0, sizeof(PerfCounters));
+    counters->group = -1;
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        counters->fds[counter] = perf_counters_open(counter, counters->group);
+        if (counters->fds[counter] < 0)
+            continue;
+
+        if (counters->group < 0)
+            counters->group = counters->fds[counter];
+        counters->position[counter] = counters->open_count++;
+        counters->available[counter] = true;
+    }
+
+    if (counters->open_count == 0)
+    {
+        free(counters);
+        return NULL;
+    }
+
+    // everything in the group starts at the same moment
+    ioctl(counters->group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return counters;
+}
+
+int perf_counters_open(PerfCounter counter, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = group < 0; // only the leader starts disabled, the rest follow it
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    switch (counter)
+    {
+    case PERF_CYCLES: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case PERF_INSTRUCTIONS: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case PERF_LLC_MISSES: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+    case PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    case PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default: return -1;
+    }
+
+    // this thread, any CPU
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+void perf_counters_read(PerfCounters* counters, int64_t values[PERF_COUNTER_COUNT])
+{
+    // nr, time_enabled, time_running, then one value per counter in the order they were opened
+    uint64_t data[3 + PERF_COUNTER_COUNT];
+    memset(values, 0, PERF_COUNTER_COUNT * sizeof(int64_t));
+
+    if (read(counters->group, data, sizeof(data)) < (ssize_t)((3 + counters->open_count) * sizeof(uint64_t)))
+        return;
+
+    uint64_t enabled = data[1];
+    uint64_t running = data[2];
+    double scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        if (counters->available[counter])
+            values[counter] = (int64_t)(data[3 + counters->position[counter]] * scale);
+    }
+}
+
+void perf_counters_destroy(PerfCounters* counters)
+{
+    if (counters)
+    {
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        {
+            if (counters->fds[counter] >= 0)
+                close(counters->fds[counter]);
+        }
+        free(counters);
+    }
+}
+
+#else
+
+// no perf_event_open anywhere else, so there's never any counters
+PerfCounters* perf_counters_create(void)
+{
+    return NULL;
+}
+
+void perf_counters_read(PerfCounters* counters, int64_t values[PERF_COUNTER_COUNT])
+{
+    (void)counters;
+    memset(values, 0, PERF_COUNTER_COUNT * sizeof(int64_t));
+}
+
+void perf_counters_destroy(PerfCounters* counters)
+{
+    (void)counters;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,    // level 1 data cache read misses
+    PERF_LLC_MISSES,    // last level cache misses, i.e. trips out to memory
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+extern const char* perf_counter_names[PERF_COUNTER_COUNT];
+
+// Hardware performance counters for the calling thread, through Linux's perf_event_open.
+// They're opened as one group so they all count over exactly the same stretch of code, and reading
+// the lot is a single read(). User space only, so it works at the default perf_event_paranoid of 2.
+// Only the thread that created them is counted: work handed to a ThreadPool's other threads doesn't show up.
+// Any counter the CPU (or VM) doesn't have is left out and reads as 0, see available.
+typedef struct
+{
+    int group;                        // the first counter that opened, the others are read through it
+    int fds[PERF_COUNTER_COUNT];      // -1 where a counter couldn't be opened
+    int position[PERF_COUNTER_COUNT]; // where each counter comes in a group read
+    int open_count;
+    bool available[PERF_COUNTER_COUNT];
+} PerfCounters;
+
+// NULL if no counter at all could be opened (not Linux, no permission, no PMU in a VM...).
+PerfCounters* perf_counters_create(void);
+// Running totals since the counters were created. When the kernel had to share the hardware with someone else
+// and only counted for part of the time, the totals are scaled up to the whole time.
+void perf_counters_read(PerfCounters* counters, int64_t values[PERF_COUNTER_COUNT]);
+void perf_counters_destroy(PerfCounters* counters);
+
+#endif
@@ -0,0 +1,217 @@
+#include "placement.h"
+#include <math.h>
+#include <stdlib.h>
+
+// next in a cell that nobody's in yet
+#define PLACEMENT_EMPTY -2
+
+// One circle in the placement grid. Its position and size are copied in next to the link, so looking at it
+// costs one cache line instead of a miss in each of the store's x, y and radius arrays.
+typedef struct
+{
+    float x;
+    float y;
+    float radius;
+    int next; // the next circle in the same cell (an index into entries) or -1
+} PlacementEntry;
+
+// The placement grid is a linked list per cell. Unlike SpatialGrid it has to answer queries in between inserts,
+// and pushing onto a list is O(1) with nothing to re-sort.
+// The first circle in each cell is kept in the cell itself and only the rest go on the list. Cells are sized for
+// about one circle each, so most lookups only read the cells and never follow a link.
+typedef struct
+{
+    float cell_size;
+    float max_radius; // biggest circle in the grid, how far outside its own cell a circle can reach
+    int rows;
+    int columns;
+    PlacementEntry* cells; // rows * columns, the first circle in each cell
+    PlacementEntry* entries; // per store index, circles after the first in their cell
+} PlacementGrid;
+
+// private prototypes
+void placement_grid_create(PlacementGrid* grid, CircleStore* circles, float cell_size, float max_radius, int world_w, int world_h, int capacity);
+void placement_grid_cell_of(PlacementGrid* grid, float x, float y, int* row, int* col);
+void placement_grid_insert(PlacementGrid* grid, CircleStore* circles, int c);
+bool placement_grid_is_free(PlacementGrid* grid, float x, float y, float radius);
+bool placement_try(PlacementGrid* grid, CircleStore* circles, PlacementRequest* request, int c);
+float placement_random(CircleStore* circles, int c, int counter, float min, float max);
+
+PlacementResult placement_spawn(CircleStore* circles, PlacementRequest request)
+{
+    PlacementResult result = {0, 0, 0.0f, true};
+    double world_area = (double)request.world_width * request.world_height;
+
+    // how much is covered already, and the biggest circle there is or will be
+    double covered = 0.0;
+    float max_radius = request.max_radius;
+    for (int i = 0; i < circles->count; i++)
+    {
+        covered += M_PI * circles->radius[i] * circles->radius[i];
+        if (circles->radius[i] > max_radius)
+            max_radius = circles->radius[i];
+    }
+
+    double mean_area = M_PI * (request.min_radius * request.min_radius + request.max_radius * request.max_radius) / 2.0;
+    double target = request.packing_fraction * world_area;
+    int expected = request.packing_fraction > 0.0f ? (int)((target - covered) / mean_area) + 1 : request.count;
+    if (expected < 0)
+        expected = 0;
+
+    // cells have to be at least a diameter across for the 3x3 check to be enough. in a big, sparse world
+    // they can be a lot bigger than that, so there's about one circle per cell instead of millions of empty cells.
+    float cell_size = 2.0f * max_radius;
+    float sparse_size = sqrtf(world_area / (circles->count + expected + 1));
+    if (sparse_size > cell_size)
+        cell_size = sparse_size;
+
+    // the whole lot fits after one allocation at most
+    circle_store_reserve(circles, circles->count + expected);
+
+    PlacementGrid grid;
+    placement_grid_create(&grid, circles, cell_size, max_radius, request.world_width, request.world_height, circles->capacity);
+
+    int failures_in_a_row = 0;
+    while (request.packing_fraction > 0.0f ? covered < target : result.placed < request.count)
+    {
+        if (circles->count == circles->capacity)
+        {
+            // only when the packing target needed more than the estimate
+            circle_store_reserve(circles, circles->capacity * 2);
+            grid.entries = realloc(grid.entries, circles->capacity * sizeof(PlacementEntry));
+        }
+
+        int c = circle_create(circles, request.min_radius, request.max_radius);
+        if (placement_try(&grid, circles, &request, c))
+        {
+            placement_grid_insert(&grid, circles, c);
+            covered += M_PI * circles->radius[c] * circles->radius[c];
+            result.placed++;
+            failures_in_a_row = 0;
+            continue;
+        }
+
+        // it's the newest circle, so taking it out again doesn't move any other
+        circle_destroy(circles, c);
+        result.failed++;
+        if (++failures_in_a_row == PLACEMENT_MAX_FAILURES)
+        {
+            result.complete = false;
+            break;
+        }
+    }
+
+    result.packing = (float)(covered / world_area);
+
+    free(grid.cells);
+    free(grid.entries);
+    return result;
+}
+
+// Up to PLACEMENT_MAX_ATTEMPTS random spots. Places the circle at the first free one.
+bool placement_try(PlacementGrid* grid, CircleStore* circles, PlacementRequest* request, int c)
+{
+    float radius = circles->radius[c];
+
+    for (int attempt = 0; attempt < PLACEMENT_MAX_ATTEMPTS; attempt++)
+    {
+        float x = placement_random(circles, c, attempt * 2, request->margin, request->world_width - request->margin);
+        float y = placement_random(circles, c, attempt * 2 + 1, request->margin, request->world_height - request->margin);
+
+        if (placement_grid_is_free(grid, x, y, radius))
+        {
+            circle_place(circles, c, x, y, request->max_speed);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The circle's own numbers, so where it lands doesn't depend on how many tries the circles before it needed
+float placement_random(CircleStore* circles, int c, int counter, float min, float max)
+{
+    return min + (max - min) * random_float(circles->seed, circle_random_key(circles, c), RANDOM_STREAM_PLACEMENT, counter);
+}
+
+void placement_grid_create(PlacementGrid* grid, CircleStore* circles, float cell_size, float max_radius, int world_w, int world_h, int capacity)
+{
+    grid->cell_size = cell_size;
+    grid->max_radius = max_radius;
+    grid->rows = (int)ceilf(world_h / cell_size);
+    grid->columns = (int)ceilf(world_w / cell_size);
+    if (grid->rows < 1)
+        grid->rows = 1;
+    if (grid->columns < 1)
+        grid->columns = 1;
+
+    grid->cells = malloc(grid->rows * grid->columns * sizeof(PlacementEntry));
+    grid->entries = malloc(capacity * sizeof(PlacementEntry));
+    for (int cell = 0; cell < grid->rows * grid->columns; cell++)
+        grid->cells[cell].next = PLACEMENT_EMPTY;
+
+    // everything that's already there has to be avoided too
+    for (int i = 0; i < circles->count; i++)
+        placement_grid_insert(grid, circles, i);
+}
+
+// Points outside the world land in the nearest edge cell, same as SpatialGrid
+void placement_grid_cell_of(PlacementGrid* grid, float x, float y, int* row, int* col)
+{
+    *row = (int)(y / grid->cell_size);
+    *col = (int)(x / grid->cell_size);
+    *row = *row < 0 ? 0 : (*row >= grid->rows ? grid->rows - 1 : *row);
+    *col = *col < 0 ? 0 : (*col >= grid->columns ? grid->columns - 1 : *col);
+}
+
+void placement_grid_insert(PlacementGrid* grid, CircleStore* circles, int c)
+{
+    int row, col;
+    placement_grid_cell_of(grid, circles->x[c], circles->y[c], &row, &col);
+
+    PlacementEntry* cell = &grid->cells[row * grid->columns + col];
+    PlacementEntry entry = {circles->x[c], circles->y[c], circles->radius[c], -1};
+    if (cell->next == PLACEMENT_EMPTY)
+    {
+        *cell = entry;
+        return;
+    }
+
+    // goes in right after the one in the cell, the order doesn't matter
+    entry.next = cell->next;
+    grid->entries[c] = entry;
+    cell->next = c;
+}
+
+// Only the cells a circle touching this one could have its centre in. Cells are at least a diameter across, so
+// that's never more than 3x3, and in a sparse world with big cells it's usually 2x2 or fewer.
+bool placement_grid_is_free(PlacementGrid* grid, float x, float y, float radius)
+{
+    float reach = radius + grid->max_radius;
+    int first_row, first_col, last_row, last_col;
+    placement_grid_cell_of(grid, x - reach, y - reach, &first_row, &first_col);
+    placement_grid_cell_of(grid, x + reach, y + reach, &last_row, &last_col);
+
+    for (int row = first_row; row <= last_row; row++)
+    {
+        for (int col = first_col; col <= last_col; col++)
+        {
+            PlacementEntry* entry = &grid->cells[row * grid->columns + col];
+            if (entry->next == PLACEMENT_EMPTY)
+                continue;
+
+            while (true)
+            {
+                float dx = entry->x - x;
+                float dy = entry->y - y;
+                float radius_sum = entry->radius + radius;
+                if (dx * dx + dy * dy < radius_sum * radius_sum)
+                    return false;
+
+                if (entry->next < 0)
+                    break;
+                entry = &grid->entries[entry->next];
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdbool.h>
+
+#include "../circle/circle.h"
+
+// Tries each circle gets at a random spot before it's given up on.
+#define PLACEMENT_MAX_ATTEMPTS 64
+// Circles in a row that can't be placed before the world is taken to be as full as it's going to get.
+#define PLACEMENT_MAX_FAILURES 32
+
+// What to add and where.
+typedef struct
+{
+    int count;              // circles to add, ignored when packing_fraction > 0
+    float packing_fraction; // > 0 keeps adding circles until everything in the store covers this fraction of the world
+    int min_radius;
+    int max_radius;
+    int max_speed;
+    int world_width;
+    int world_height;
+    int margin; // centres are kept at least this far from the edges of the world
+} PlacementRequest;
+
+typedef struct
+{
+    int placed;        // circles added to the store
+    int failed;        // circles that found nowhere to go and were taken out again
+    float packing;     // fraction of the world covered by everything in the store afterwards
+    bool complete;     // false if it stopped short of count (or packing_fraction) because the world was too full
+} PlacementResult;
+
+// Adds circles at random spots where they don't overlap anything already in the store (random sequential addition).
+// Overlap checks go through a grid with cells at least as big as the biggest diameter, so each try looks at no more
+// than the 3x3 cells around it and placing n circles is O(n) rather than O(n^2), for as long as there's room.
+// Random addition jams at a bit over half of the world covered, so asking for much more than 0.5 will come back incomplete.
+PlacementResult placement_spawn(CircleStore* circles, PlacementRequest request);
+
+#endif
@@ -0,0 +1,192 @@
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// private prototypes
+void profiler_flush_csv(Profiler* profiler);
+
+const char* profiler_phase_names[PROFILE_PHASE_COUNT] = {
+    "move",
+    "broad_phase",
+    "circle_collisions",
+    "wall_collisions",
+    "reorder",
+    "sleep",
+    "render",
+};
+
+Profiler* profiler_create(const char* csv_path, bool hardware_counters)
+{
+    Profiler* profiler = malloc(sizeof(Profiler));
+    memset(profiler, 0, sizeof(Profiler));
+
+    if (hardware_counters)
+        profiler->counters = perf_counters_create();
+
+    if (csv_path)
+    {
+        profiler->csv = fopen(csv_path, "w");
+        if (!profiler->csv)
+        {
+            perf_counters_destroy(profiler->counters);
+            free(profiler);
+            return NULL;
+        }
+
+        fprintf(profiler->csv, "frame");
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
+            fprintf(profiler->csv, ",%s_ns", profiler_phase_names[phase]);
+        fprintf(profiler->csv, ",candidate_pairs,contacts,occupied_cells,max_cell_occupancy,neighbour_pairs,neighbour_rebuilds");
+
+        // only the counters that opened get a column
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT && profiler->counters; phase++)
+        {
+            for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            {
+                if (profiler->counters->available[counter])
+                    fprintf(profiler->csv, ",%s_%s", profiler_phase_names[phase], perf_counter_names[counter]);
+            }
+        }
+        fprintf(profiler->csv, "\n");
+    }
+
+    return profiler;
+}
+
+// CLOCK_MONOTONIC never jumps backwards when the wall clock is changed
+int64_t profiler_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// the counters are read outside the clock, so the clock's own cost isn't counted against the phase
+void profiler_begin(Profiler* profiler, ProfilePhase phase)
+{
+    if (!profiler)
+        return;
+
+    if (profiler->counters)
+        perf_counters_read(profiler->counters, profiler->counter_start[phase]);
+    profiler->phase_start[phase] = profiler_now_ns();
+}
+
+void profiler_end(Profiler* profiler, ProfilePhase phase)
+{
+    if (!profiler)
+        return;
+
+    profiler->current.phase_ns[phase] += profiler_now_ns() - profiler->phase_start[phase];
+
+    if (profiler->counters)
+    {
+        int64_t now[PERF_COUNTER_COUNT];
+        perf_counters_read(profiler->counters, now);
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            profiler->current.phase_counters[phase][counter] += now[counter] - profiler->counter_start[phase][counter];
+    }
+}
+
+void profiler_end_frame(Profiler* profiler)
+{
+    if (!profiler)
+        return;
+
+    profiler->frames[profiler->frame_count % PROFILER_HISTORY] = profiler->current;
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT && profiler->counters; phase++)
+    {
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            profiler->counter_totals[phase][counter] += profiler->current.phase_counters[phase][counter];
+    }
+    profiler->frame_count++;
+    memset(&profiler->current, 0, sizeof(ProfileFrame));
+
+    // write the ring out just before it starts overwriting frames that haven't been written yet
+    if (profiler->csv && profiler->frame_count - profiler->csv_written == PROFILER_HISTORY)
+        profiler_flush_csv(profiler);
+}
+
+void profiler_flush_csv(Profiler* profiler)
+{
+    for (int64_t frame = profiler->csv_written; frame < profiler->frame_count; frame++)
+    {
+        ProfileFrame* f = &profiler->frames[frame % PROFILER_HISTORY];
+        fprintf(profiler->csv, "%lld", (long long)frame);
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
+            fprintf(profiler->csv, ",%lld", (long long)f->phase_ns[phase]);
+        fprintf(profiler->csv, ",%lld,%lld,%d,%d,%d,%d", (long long)f->candidate_pairs, (long long)f->contacts,
+                f->occupied_cells, f->max_cell_occupancy, f->neighbour_pairs, f->neighbour_rebuilds);
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT && profiler->counters; phase++)
+        {
+            for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            {
+                if (profiler->counters->available[counter])
+                    fprintf(profiler->csv, ",%lld", (long long)f->phase_counters[phase][counter]);
+            }
+        }
+        fprintf(profiler->csv, "\n");
+    }
+    profiler->csv_written = profiler->frame_count;
+}
+
+ProfileFrame profiler_average(Profiler* profiler, int frames)
+{
+    ProfileFrame average;
+    memset(&average, 0, sizeof(ProfileFrame));
+
+    if (frames > PROFILER_HISTORY)
+        frames = PROFILER_HISTORY;
+    if (frames > profiler->frame_count)
+        frames = profiler->frame_count;
+    if (frames == 0)
+        return average;
+
+    for (int i = 1; i <= frames; i++)
+    {
+        ProfileFrame* f = &profiler->frames[(profiler->frame_count - i) % PROFILER_HISTORY];
+        for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
+        {
+            average.phase_ns[phase] += f->phase_ns[phase];
+            for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+                average.phase_counters[phase][counter] += f->phase_counters[phase][counter];
+        }
+        average.candidate_pairs += f->candidate_pairs;
+        average.contacts += f->contacts;
+        average.occupied_cells += f->occupied_cells;
+        average.neighbour_pairs += f->neighbour_pairs;
+        average.neighbour_rebuilds += f->neighbour_rebuilds;
+
+        // max stays a max, it isn't averaged
+        if (f->max_cell_occupancy > average.max_cell_occupancy)
+            average.max_cell_occupancy = f->max_cell_occupancy;
+    }
+
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
+    {
+        average.phase_ns[phase] /= frames;
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            average.phase_counters[phase][counter] /= frames;
+    }
+    average.candidate_pairs /= frames;
+    average.contacts /= frames;
+    average.occupied_cells /= frames;
+    average.neighbour_pairs /= frames;
+
+    return average;
+}
+
+void profiler_destroy(Profiler* profiler)
+{
+    if (profiler)
+    {
+        if (profiler->csv)
+        {
+            profiler_flush_csv(profiler);
+            fclose(profiler->csv);
+        }
+        perf_counters_destroy(profiler->counters);
+        free(profiler);
+    }
+}
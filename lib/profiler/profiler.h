@@ -0,0 +1,73 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../perf_counters/perf_counters.h"
+
+typedef enum
+{
+    PROFILE_MOVE,
+    PROFILE_BROAD_PHASE, // building or updating the grid (or whichever broad phase is in use)
+    PROFILE_CIRCLE_COLLISIONS,
+    PROFILE_WALL_COLLISIONS,
+    PROFILE_REORDER, // sorting the circle store back into spatial order, see spatial_order.h
+    PROFILE_SLEEP,   // counting still steps and putting calm islands to sleep, see sleep.h
+    PROFILE_RENDER,
+    PROFILE_PHASE_COUNT
+} ProfilePhase;
+
+// Everything measured for one frame. Times are in nanoseconds.
+typedef struct
+{
+    int64_t phase_ns[PROFILE_PHASE_COUNT];
+    int64_t candidate_pairs; // pairs that got a distance test
+    int64_t contacts;        // pairs that were actually overlapping
+    int occupied_cells;
+    int max_cell_occupancy;
+    int neighbour_pairs;    // size of the neighbour list, 0 when there isn't one
+    int neighbour_rebuilds; // times the neighbour list was rebuilt
+    // hardware counter deltas for each phase, all 0 unless the profiler was created with counters (see perf_counters.h)
+    int64_t phase_counters[PROFILE_PHASE_COUNT][PERF_COUNTER_COUNT];
+} ProfileFrame;
+
+// Frames are kept in a ring buffer. Recording a frame is a copy into the ring,
+// the CSV (if any) is only written a whole ring at a time, so profiling costs next to nothing per frame.
+#define PROFILER_HISTORY 256
+
+typedef struct
+{
+    ProfileFrame frames[PROFILER_HISTORY];
+    int64_t frame_count; // frames recorded so far, the newest is frames[(frame_count - 1) % PROFILER_HISTORY]
+    int64_t csv_written; // frames already written to the CSV
+    ProfileFrame current;
+    int64_t phase_start[PROFILE_PHASE_COUNT];
+    FILE* csv;
+
+    PerfCounters* counters; // NULL if they weren't asked for or couldn't be opened
+    int64_t counter_start[PROFILE_PHASE_COUNT][PERF_COUNTER_COUNT];
+    int64_t counter_totals[PROFILE_PHASE_COUNT][PERF_COUNTER_COUNT]; // every frame since the profiler was created
+} Profiler;
+
+extern const char* profiler_phase_names[PROFILE_PHASE_COUNT];
+
+// csv_path can be NULL to skip the CSV. Returns NULL if the CSV can't be opened.
+// hardware_counters also reads the CPU's counters around every phase. They only count the thread that creates
+// the profiler, so that has to be the thread running the phases. If none can be opened the profiler carries on
+// with timings only and counters stays NULL.
+Profiler* profiler_create(const char* csv_path, bool hardware_counters);
+
+// All of these do nothing when profiler is NULL, so callers don't need to check.
+void profiler_begin(Profiler* profiler, ProfilePhase phase);
+void profiler_end(Profiler* profiler, ProfilePhase phase);
+void profiler_end_frame(Profiler* profiler);
+
+// Average of the last (up to) frames recorded frames. neighbour_rebuilds is the total over those frames, not an average.
+ProfileFrame profiler_average(Profiler* profiler, int frames);
+void profiler_destroy(Profiler* profiler);
+
+int64_t profiler_now_ns(void);
+
+#endif
@@ -0,0 +1,37 @@
+#include "random.h"
+
+// private prototypes
+uint64_t random_mix(uint64_t x);
+
+// splitmix64's finaliser. every input bit ends up affecting every output bit.
+uint64_t random_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Each input goes through the mixer before the next one is folded in, so nearby keys or counters
+// (circle 7 and circle 8, step 100 and step 101) come out unrelated.
+uint64_t random_bits(uint64_t seed, uint64_t key, RandomStream stream, uint64_t counter)
+{
+    uint64_t x = random_mix(seed + 0x9e3779b97f4a7c15ull);
+    x = random_mix(x ^ key);
+    x = random_mix(x ^ ((uint64_t)stream << 56) ^ counter);
+    return x;
+}
+
+float random_float(uint64_t seed, uint64_t key, RandomStream stream, uint64_t counter)
+{
+    // the top 24 bits fit a float's mantissa exactly, so this never rounds up to 1
+    return (random_bits(seed, key, stream, counter) >> 40) * (1.0f / 16777216.0f);
+}
+
+int random_int(uint64_t seed, uint64_t key, RandomStream stream, uint64_t counter, int min, int max)
+{
+    uint64_t range = (uint64_t)(max - min) + 1;
+    return min + (int)(random_bits(seed, key, stream, counter) % range);
+}
@@ -0,0 +1,25 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// Counter-based random numbers: each one is a pure function of (seed, key, stream, counter) and nothing
+// is kept between calls. Whichever thread asks, and in whatever order, the same inputs give the same number,
+// so runs repeat exactly no matter how the work is split up. The physics keys numbers by circle
+// (see circle_random_key) and counts with the step number, so every circle gets its own sequence.
+typedef enum
+{
+    RANDOM_STREAM_RADIUS,
+    RANDOM_STREAM_VELOCITY,
+    RANDOM_STREAM_COLOUR,
+    RANDOM_STREAM_PLACEMENT,
+    RANDOM_STREAM_DESPAWN,
+} RandomStream;
+
+uint64_t random_bits(uint64_t seed, uint64_t key, RandomStream stream, uint64_t counter);
+// [0, 1)
+float random_float(uint64_t seed, uint64_t key, RandomStream stream, uint64_t counter);
+// [min, max], both included
+int random_int(uint64_t seed, uint64_t key, RandomStream stream, uint64_t counter, int min, int max);
+
+#endif
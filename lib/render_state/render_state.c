@@ -0,0 +1,53 @@
+#include "render_state.h"
+#include <stdlib.h>
+#include <string.h>
+
+RenderState* render_state_create(void)
+{
+    RenderState* state = malloc(sizeof(RenderState));
+    memset(state->frames, 0, sizeof(state->frames));
+
+    for (int i = 0; i < 3; i++)
+        state->frames[i].circles = circle_store_create(0, 0);
+
+    state->back = 0;
+    state->front = 1;
+    atomic_init(&state->ready, 2);
+    return state;
+}
+
+RenderFrame* render_state_back(RenderState* state)
+{
+    return &state->frames[state->back];
+}
+
+void render_state_publish(RenderState* state)
+{
+    // whatever was in ready is either the renderer's old front (already swapped out) or a frame it never saw,
+    // both are free to be filled again
+    int previous = atomic_exchange(&state->ready, state->back | RENDER_STATE_FRESH);
+    state->back = previous & ~RENDER_STATE_FRESH;
+}
+
+RenderFrame* render_state_acquire(RenderState* state)
+{
+    if (atomic_load(&state->ready) & RENDER_STATE_FRESH)
+    {
+        // no other thread clears the flag, so it's still set here and this gets the frame that was just published
+        int previous = atomic_exchange(&state->ready, state->front);
+        state->front = previous & ~RENDER_STATE_FRESH;
+    }
+
+    RenderFrame* frame = &state->frames[state->front];
+    return frame->tick > 0 ? frame : NULL;
+}
+
+void render_state_destroy(RenderState* state)
+{
+    if (state)
+    {
+        for (int i = 0; i < 3; i++)
+            circle_store_destroy(state->frames[i].circles);
+        free(state);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "../circle/circle.h"
+#include "../profiler/profiler.h"
+
+// Everything the renderer needs from one physics tick, copied out so it can be drawn while the next ticks run.
+typedef struct
+{
+    CircleStore* circles; // positions, previous positions, radii and colours. velocities aren't copied.
+    double tick_time;     // when (al_get_time) the latest tick in here was due, for working out how far between ticks to draw
+    int64_t tick;         // ticks run so far
+
+    // the uniform grid's layout, all 0 if another broad phase is in use
+    int grid_rows;
+    int grid_columns;
+    int cell_width;
+    int cell_height;
+
+    ProfileFrame profile; // the physics thread's averages over its last few ticks
+} RenderFrame;
+
+// A lock-free triple buffer between one physics thread and one render thread.
+// The physics thread always has a frame of its own to fill (back), the renderer always has one of its own
+// to draw (front), and the third is the latest finished frame waiting to be picked up (ready).
+// Publishing and picking up are a single atomic exchange of the ready index each, so neither thread ever
+// waits for the other: physics can publish as often as it likes, and the renderer just gets the newest.
+#define RENDER_STATE_FRESH 4 // set in ready while the frame there hasn't been picked up yet
+
+typedef struct
+{
+    RenderFrame frames[3];
+    int back;         // physics thread only
+    int front;        // render thread only
+    atomic_int ready; // frame index, | RENDER_STATE_FRESH when it's newer than front
+} RenderState;
+
+RenderState* render_state_create(void);
+// The frame the physics thread fills next.
+RenderFrame* render_state_back(RenderState* state);
+// Hands the back frame to the renderer and takes an unused one as the new back.
+void render_state_publish(RenderState* state);
+// The newest published frame, or the same one as last time if nothing new has been published.
+// It stays untouched by the physics thread until the next call. NULL until the first publish.
+RenderFrame* render_state_acquire(RenderState* state);
+void render_state_destroy(RenderState* state);
+
+#endif
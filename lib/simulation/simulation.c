@@ -0,0 +1,204 @@
+#include "simulation.h"
+#include "../collision/window_bounds_collider/window_bounds_collider.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// private prototypes
+PlacementRequest simulation_placement_request(Simulation* sim, int count);
+
+Simulation* simulation_create(SimulationSettings settings)
+{
+    Simulation* sim = malloc(sizeof(Simulation));
+    sim->settings = settings;
+    sim->bounds.width = settings.world_width;
+    sim->bounds.height = settings.world_height;
+
+    sim->last_stats.candidate_pairs = 0;
+    sim->last_stats.contacts = 0;
+
+    sim->step = 0;
+
+    // worker threads for the collision pass
+    sim->pool = pool_create(settings.thread_count);
+    sim->profiler = NULL;
+
+    // create the circle store. every circle lives in its arrays.
+    // the starting circles go in the same way as any spawned later, a packing fraction only makes sense here.
+    sim->circles = circle_store_create(settings.circle_count, settings.seed);
+    PlacementRequest request = simulation_placement_request(sim, settings.circle_count);
+    request.packing_fraction = settings.packing_fraction;
+    sim->placement = placement_spawn(sim->circles, request);
+    sim->circles->restitution = settings.restitution;
+    sim->circles->damping = settings.damping;
+
+    // the broad phase is fitted to the circles, so it comes last
+    BroadPhaseSettings broad_phase_settings;
+    broad_phase_settings.cell_size = settings.cell_size;
+    broad_phase_settings.neighbour_skin = settings.neighbour_skin;
+    broad_phase_settings.incremental_grid = settings.incremental_grid;
+    sim->broad_phase = broad_phase_create(settings.broad_phase, broad_phase_settings, sim->circles, settings.world_width, settings.world_height);
+    sim->broad_phase_fitted_count = sim->circles->count;
+
+    // the first step sorts the circles, placement put them in random order
+    sim->order = NULL;
+    if (settings.reorder_threshold > 0.0f)
+        sim->order = spatial_order_create(settings.reorder_threshold, settings.circle_max_radius * 2.0f);
+
+    sim->sleep = NULL;
+    if (settings.sleep_speed > 0.0f)
+    {
+        sim->sleep = sleep_create(settings.sleep_speed);
+        broad_phase_set_contact_log(sim->broad_phase, sim->sleep->contacts);
+    }
+
+    return sim;
+}
+
+PlacementResult simulation_spawn(Simulation* sim, int count)
+{
+    sim->placement = placement_spawn(sim->circles, simulation_placement_request(sim, count));
+    return sim->placement;
+}
+
+PlacementRequest simulation_placement_request(Simulation* sim, int count)
+{
+    PlacementRequest request;
+    request.count = count;
+    request.packing_fraction = 0.0f;
+    request.min_radius = sim->settings.circle_min_radius;
+    request.max_radius = sim->settings.circle_max_radius;
+    request.max_speed = sim->settings.circle_max_speed;
+    request.world_width = sim->bounds.width;
+    request.world_height = sim->bounds.height;
+    request.margin = 50; // same as it's always been, keeps new circles off the walls
+    return request;
+}
+
+bool simulation_despawn(Simulation* sim, CircleHandle handle)
+{
+    int index = circle_from_handle(sim->circles, handle);
+    if (index < 0)
+        return false;
+
+    circle_destroy(sim->circles, index);
+    return true;
+}
+
+void simulation_fit_broad_phase(Simulation* sim)
+{
+    broad_phase_fit(sim->broad_phase, sim->circles, sim->bounds.width, sim->bounds.height);
+    sim->broad_phase_fitted_count = sim->circles->count;
+}
+
+void simulation_resize_world(Simulation* sim, int world_w, int world_h)
+{
+    sim->bounds.width = world_w;
+    sim->bounds.height = world_h;
+    simulation_fit_broad_phase(sim);
+}
+
+void simulation_set_profiler(Simulation* sim, Profiler* profiler)
+{
+    sim->profiler = profiler;
+}
+
+void update_physics(Simulation* sim)
+{
+    CircleStore* circles = sim->circles;
+    Profiler* profiler = sim->profiler;
+    sim->step++;
+
+    // circles wander away from their neighbours in the store as they move, every so often see how far they've got.
+    // this goes first so the positions it moves around are the ones the rest of the step starts from.
+    if (sim->order && sim->step % SPATIAL_ORDER_CHECK_STEPS == 1)
+    {
+        profiler_begin(profiler, PROFILE_REORDER);
+        spatial_order_update(sim->order, circles);
+        profiler_end(profiler, PROFILE_REORDER);
+    }
+
+    // the best cell size depends on how many circles there are
+    int drift = abs(circles->count - sim->broad_phase_fitted_count);
+    if (drift * 4 > sim->broad_phase_fitted_count)
+        simulation_fit_broad_phase(sim);
+
+    // the neighbour list (if there is one) only gets rebuilt every few steps, count when it does
+    NeighbourList* nlist = broad_phase_current(sim->broad_phase)->nlist;
+    int64_t builds_before = nlist ? nlist->builds : 0;
+
+    // --- 1. UPDATE PHASE (Integrate Movement) ---
+    // The grid can move the circles as it builds, one pass over them (split across the threads) instead of two.
+    // Then the move shows up in the broad phase's time and PROFILE_MOVE stays at 0.
+    profiler_begin(profiler, PROFILE_BROAD_PHASE);
+    bool moved = broad_phase_move_and_build(sim->broad_phase, circles, sim->pool);
+    profiler_end(profiler, PROFILE_BROAD_PHASE);
+
+    if (!moved)
+    {
+        // Move all circles based on their current velocities.
+        profiler_begin(profiler, PROFILE_MOVE);
+        circle_remember_positions(circles);
+        circle_move(circles);
+        profiler_end(profiler, PROFILE_MOVE);
+
+        // every backend clears and refills (or just updates) itself here
+        profiler_begin(profiler, PROFILE_BROAD_PHASE);
+        broad_phase_build(sim->broad_phase, circles);
+        profiler_end(profiler, PROFILE_BROAD_PHASE);
+    }
+
+    // --- 2. RESOLVE PHASE (Handle All Collisions) ---
+    // A. Resolve Circle-Circle Collisions
+    // This resolves overlaps and applies rebound velocities for pairs.
+    CollisionStats stats;
+    profiler_begin(profiler, PROFILE_CIRCLE_COLLISIONS);
+    broad_phase_collide(sim->broad_phase, circles, sim->pool, &stats);
+    sim->last_stats = stats;
+
+    // everything that collided gets a new colour, once, now that no thread is colliding any more
+    circle_recolour_collided(circles, sim->step);
+    profiler_end(profiler, PROFILE_CIRCLE_COLLISIONS);
+    
+
+    // B. Resolve Circle-Wall Collisions
+    // This prevents spheres from getting stuck in the walls.
+    profiler_begin(profiler, PROFILE_WALL_COLLISIONS);
+    wbcoll_rebound_velocity(circles, sim->bounds);
+    profiler_end(profiler, PROFILE_WALL_COLLISIONS);
+
+    // C. Put settled islands to sleep, now that this step's bounces have happened
+    if (sim->sleep)
+    {
+        profiler_begin(profiler, PROFILE_SLEEP);
+        sleep_update(sim->sleep, circles);
+        profiler_end(profiler, PROFILE_SLEEP);
+    }
+
+    if (profiler)
+    {
+        // counters add up, in case a frame runs more than one physics step
+        profiler->current.candidate_pairs += stats.candidate_pairs;
+        profiler->current.contacts += stats.contacts;
+        broad_phase_get_occupancy(sim->broad_phase, &profiler->current.occupied_cells, &profiler->current.max_cell_occupancy);
+
+        if (nlist)
+        {
+            profiler->current.neighbour_pairs = nlist->pair_count;
+            profiler->current.neighbour_rebuilds += (int)(nlist->builds - builds_before);
+        }
+    }
+}
+
+void simulation_destroy(Simulation* sim)
+{
+    if (sim)
+    {
+        pool_destroy(sim->pool);
+        circle_store_destroy(sim->circles);
+        broad_phase_destroy(sim->broad_phase);
+        spatial_order_destroy(sim->order);
+        sleep_destroy(sim->sleep);
+        free(sim);
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "../broad_phase/broad_phase.h"
+#include "../circle/circle.h"
+#include "../collision/circle_collider/circle_collider.h"
+#include "../placement/placement.h"
+#include "../profiler/profiler.h"
+#include "../sleep/sleep.h"
+#include "../spatial_order/spatial_order.h"
+#include "../thread_pool/thread_pool.h"
+#include "../window/window.h"
+
+typedef struct
+{
+    int circle_count;
+    int circle_min_radius;
+    int circle_max_radius;
+    int circle_max_speed;
+    int thread_count; // threads used for collision resolution, 1 keeps everything on the calling thread
+    int world_width;
+    int world_height;
+    int cell_size; // grid cell size in pixels, 0 lets the grid pick one from the circles (see grid_choose_cell_size)
+    BroadPhaseType broad_phase; // see broad_phase.h
+    // > 0 caches the pairs within this many pixels of touching and only rebuilds the grid when something has moved
+    // more than half of it (see neighbour_list.h). Only used with BROAD_PHASE_GRID. 0 rebuilds the grid every step.
+    float neighbour_skin;
+    // keeps the grid from step to step and only moves the circles that crossed into another cell (see
+    // grid_update_incremental), instead of sorting every circle again. Only used with BROAD_PHASE_GRID.
+    bool incremental_grid;
+    // how much of their speed along the line between them two circles keep when they bounce, 1 keeps all of it.
+    // the walls always bounce circles off at full speed.
+    float restitution;
+    float damping; // fraction of its velocity every circle loses each step, 0 loses nothing
+    // > 0 puts circles to sleep once they and everything touching them have been slower than this (pixels per step)
+    // for a while, and skips colliding them until something runs into them (see sleep.h). 0 never sleeps.
+    float sleep_speed;
+    unsigned int seed; // every random number in the simulation comes from this (see random.h), so runs can be repeated
+    // > 0 ignores circle_count and places circles until they cover this fraction of the world (see placement.h)
+    float packing_fraction;
+    // > 0 sorts the circle store by position whenever more than this fraction of it has drifted away from its
+    // neighbours in memory (0 to 1, see spatial_order.h), so neighbours in the world stay neighbours in memory. 0 never sorts.
+    float reorder_threshold;
+} SimulationSettings;
+
+// Everything the physics needs, with no Allegro display attached,
+// so it can be driven by the window in main.c or headless by bench.c.
+typedef struct
+{
+    SimulationSettings settings;
+    Window bounds;
+    CircleStore* circles;
+    BroadPhase* broad_phase;
+    ThreadPool* pool;
+    Profiler* profiler; // NULL unless someone wants per-phase timings, see simulation_set_profiler
+    SpatialOrder* order; // NULL unless settings.reorder_threshold > 0
+    SleepIslands* sleep; // NULL unless settings.sleep_speed > 0
+
+    int broad_phase_fitted_count; // the population the broad phase was last fitted to
+    CollisionStats last_stats;    // from the latest step, to compare against the grid's estimated_pairs
+    PlacementResult placement;    // how the latest simulation_spawn (or the starting circles) went
+    int64_t step;                 // physics steps run so far, the counter for anything random during a step
+} Simulation;
+
+Simulation* simulation_create(SimulationSettings settings);
+void update_physics(Simulation* sim);
+// The simulation doesn't own the profiler. Pass NULL to stop profiling.
+void simulation_set_profiler(Simulation* sim, Profiler* profiler);
+// Changes the size of the world (e.g. the window was resized). Circles outside it get pushed back in by the walls.
+void simulation_resize_world(Simulation* sim, int world_w, int world_h);
+// Adds count circles at random free spots, the same way the starting circles were placed. Everything the broad
+// phases and colliders keep between steps follows the store's layout_version, so nothing else has to be told.
+// If the world is too full for all of them, as many as fit are added and the result says so.
+PlacementResult simulation_spawn(Simulation* sim, int count);
+// Removes the handle's circle. False if it was already gone.
+bool simulation_despawn(Simulation* sim, CircleHandle handle);
+// Fits the broad phase (e.g. the grid's cell size) to the current circles and world again.
+// update_physics does this by itself when the population changes by more than a quarter.
+void simulation_fit_broad_phase(Simulation* sim);
+void simulation_destroy(Simulation* sim);
+
+#endif
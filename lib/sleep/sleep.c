@@ -0,0 +1,146 @@
+#include "sleep.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// private prototypes
+void sleep_reserve(SleepIslands* sleep, int count);
+void sleep_find_islands(SleepIslands* sleep, CircleStore* circles);
+int sleep_find(int* parent, int circle);
+
+SleepIslands* sleep_create(float speed)
+{
+    SleepIslands* sleep = malloc(sizeof(SleepIslands));
+    memset(sleep, 0, sizeof(SleepIslands));
+    sleep->speed = speed;
+    sleep->contacts = ccoll_pair_log_create();
+    return sleep;
+}
+
+void sleep_update(SleepIslands* sleep, CircleStore* circles)
+{
+    float limit = sleep->speed * sleep->speed;
+    int ready = 0;
+    int asleep = 0;
+
+    for (int i = 0; i < circles->count; i++)
+    {
+        // woken by the collider this step, it can move from now on
+        if (circles->asleep[i] == CIRCLE_WOKEN)
+            circles->asleep[i] = 0;
+
+        if (circles->asleep[i])
+        {
+            asleep++;
+            continue;
+        }
+
+        float speed_squared = circles->vx[i] * circles->vx[i] + circles->vy[i] * circles->vy[i];
+        if (speed_squared >= limit)
+            circles->still_steps[i] = 0;
+        else if (circles->still_steps[i] < 255)
+            circles->still_steps[i]++;
+
+        ready += circles->still_steps[i] >= SLEEP_STILL_STEPS;
+    }
+    sleep->asleep = asleep;
+
+    // circles were added, removed or moved since the contacts started, so their indexes mean something else now.
+    // start again, and only look once there's a whole SLEEP_CHECK_STEPS of contacts to go on.
+    if (circles->layout_version != sleep->layout_version)
+    {
+        sleep->layout_version = circles->layout_version;
+        sleep->contacts->pair_count = 0;
+        sleep->gathered_steps = 0;
+    }
+
+    if (++sleep->gathered_steps < SLEEP_CHECK_STEPS)
+        return;
+
+    // nothing's been still long enough, so no island could sleep anyway
+    if (ready > 0)
+    {
+        sleep->checks++;
+        sleep_find_islands(sleep, circles);
+    }
+    sleep->contacts->pair_count = 0;
+    sleep->gathered_steps = 0;
+}
+
+// Joins every pair of circles that touched since the last look into the same island, then puts every island
+// with nothing still moving in it to sleep.
+void sleep_find_islands(SleepIslands* sleep, CircleStore* circles)
+{
+    sleep_reserve(sleep, circles->count);
+    for (int i = 0; i < circles->count; i++)
+        sleep->parent[i] = i;
+
+    CollisionPairLog* contacts = sleep->contacts;
+    for (int pair = 0; pair < contacts->pair_count; pair++)
+    {
+        int root1 = sleep_find(sleep->parent, contacts->first[pair]);
+        int root2 = sleep_find(sleep->parent, contacts->second[pair]);
+        if (root1 != root2)
+            sleep->parent[root1 > root2 ? root1 : root2] = root1 < root2 ? root1 : root2;
+    }
+
+    // an island is calm until one of its circles is still moving
+    for (int i = 0; i < circles->count; i++)
+        sleep->calm[i] = 1;
+    for (int i = 0; i < circles->count; i++)
+    {
+        if (!circles->asleep[i] && circles->still_steps[i] < SLEEP_STILL_STEPS)
+            sleep->calm[sleep_find(sleep->parent, i)] = 0;
+    }
+
+    for (int i = 0; i < circles->count; i++)
+    {
+        int root = sleep_find(sleep->parent, i);
+        if (circles->asleep[i] || !sleep->calm[root])
+            continue;
+
+        // 2 once the island's been counted
+        if (sleep->calm[root] == 1)
+        {
+            sleep->calm[root] = 2;
+            sleep->islands++;
+        }
+
+        circles->asleep[i] = CIRCLE_ASLEEP;
+        circles->vx[i] = 0.0f;
+        circles->vy[i] = 0.0f;
+        sleep->asleep++;
+    }
+}
+
+// path halving: every circle on the way up ends up pointing at its grandparent
+int sleep_find(int* parent, int circle)
+{
+    while (parent[circle] != circle)
+    {
+        parent[circle] = parent[parent[circle]];
+        circle = parent[circle];
+    }
+    return circle;
+}
+
+void sleep_reserve(SleepIslands* sleep, int count)
+{
+    if (count <= sleep->capacity)
+        return;
+
+    sleep->capacity = count;
+    sleep->parent = realloc(sleep->parent, count * sizeof(int));
+    sleep->calm = realloc(sleep->calm, count * sizeof(uint8_t));
+}
+
+void sleep_destroy(SleepIslands* sleep)
+{
+    if (sleep)
+    {
+        ccoll_pair_log_destroy(sleep->contacts);
+        free(sleep->parent);
+        free(sleep->calm);
+        free(sleep);
+    }
+}
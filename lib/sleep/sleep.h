@@ -0,0 +1,53 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include <stdint.h>
+
+#include "../circle/circle.h"
+#include "../collision/circle_collider/circle_collider.h"
+
+// Steps in a row a circle has to be slower than the sleep speed before it can fall asleep.
+#define SLEEP_STILL_STEPS 32
+// Steps between looks for islands that can go to sleep.
+#define SLEEP_CHECK_STEPS 8
+
+// Puts settled circles to sleep, so a pile that's stopped moving stops costing anything to collide.
+//
+// Every step each circle's still_steps counts how long it's been slower than speed. Every SLEEP_CHECK_STEPS the
+// circles are split into islands, circles joined by chains of circles that bumped into each other since the last
+// look, and an island goes to sleep only if every circle in it has been still for SLEEP_STILL_STEPS (or is already
+// asleep). A whole island at once, so a circle at rest in a pile isn't frozen while the circle next to it is still
+// pushing on it. Which circles bumped comes from the collider (contacts, see broad_phase_set_contact_log), so
+// finding the islands costs a pass over those pairs and nothing that grows with the size of the world.
+// Sleeping circles don't move and get no velocity, and the collider skips any pair where both are asleep (see
+// ccoll_batch_add). They're still in the broad phase, so awake circles can find them.
+// The collider wakes both circles whenever an overlapping pair is closing, which is how a sleeping island gets
+// woken by something running into it: the circle it hit starts moving, hits the next, and so on.
+//
+// Nothing slows down unless the circles lose speed, through CircleStore.damping or restitution below 1.
+// Restitution alone isn't much use: a dense crowd keeps nudging itself, and one big island with a single
+// circle still moving can't sleep. A little damping lets whole piles come to rest.
+typedef struct
+{
+    float speed; // pixels per step
+    CollisionPairLog* contacts; // every pair the collider resolved since the last look, in store indexes
+    int64_t layout_version;     // the store's, when the contacts started being gathered
+    int gathered_steps;         // steps of contacts in there
+
+    int capacity;
+    int* parent; // union-find over the circles, parent[i] == i for the root of an island
+    uint8_t* calm; // per root: every circle in the island could sleep
+
+    int asleep;        // circles asleep after the last step
+    int64_t checks;    // times islands were worked out
+    int64_t islands;   // islands that have gone to sleep
+} SleepIslands;
+
+// speed is how slow (pixels per step) a circle has to be to count as still.
+// Hand contacts to the broad phase with broad_phase_set_contact_log, that's where the islands come from.
+SleepIslands* sleep_create(float speed);
+// Once per step, after the collisions. Counts still steps, and every SLEEP_CHECK_STEPS puts calm islands to sleep.
+void sleep_update(SleepIslands* sleep, CircleStore* circles);
+void sleep_destroy(SleepIslands* sleep);
+
+#endif
@@ -1,139 +1,587 @@
 #include "spatial_grid.h"
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-// prototypes
-int get_circle_row(SpatialGrid *grid, Circle *circle);
-int get_circle_column(SpatialGrid *grid, Circle *circle);
+// everything grid_build's tasks need
+typedef struct
+{
+    SpatialGrid *grid;
+    const float *x;
+    const float *y;
+    int count;
+    int chunk_count; // chunks of circles, and also ranges of cells for the prefix sum
+    int chunk_size;  // circles per chunk
+    int range_size;  // cells per range
+    int *range_start;
+    GridChunkTask before_chunk;
+    void *context;
+} GridBuild;
 
-SpatialGrid *grid_create(int circle_count, int world_w, int world_h, int cell_w, int cell_h)
+// prototypes
+int get_circle_row(SpatialGrid *grid, float y);
+int get_circle_column(SpatialGrid *grid, float x);
+void grid_reserve(SpatialGrid *grid, int circle_count);
+double grid_estimate_cell_size(GridCellChoice *choice, int size, int diameter, int count, int world_w, int world_h);
+void grid_build_count(void *context, int chunk, int worker);
+void grid_build_sum(void *context, int range, int worker);
+void grid_build_offsets(void *context, int range, int worker);
+void grid_build_scatter(void *context, int chunk, int worker);
+
+SpatialGrid *grid_create(int circle_count, int world_w, int world_h, int cell_w, int cell_h, int reach)
 {
     SpatialGrid *grid = malloc(sizeof(SpatialGrid));
 
-    grid->circle_count = circle_count;
+    grid->circle_count = 0;
+    grid->cell_count = NULL;
+    grid->cell_start = NULL;
+    grid->cell_capacity = NULL;
+    grid_resize(grid, world_w, world_h, cell_w, cell_h, reach);
+
+    grid->pending = NULL;
+    grid->pending_cell = NULL;
+    grid->circles = NULL;
+    grid->chunk_capacity = 0;
+    grid->chunk_cells = NULL;
+    grid->storage_capacity = 0;
+    grid->circle_cell = NULL;
+    grid->circle_position = NULL;
+    grid->relinked = 0;
+    grid->incremental_builds = 0;
+    grid_reserve(grid, circle_count);
+
+    return grid;
+}
 
+void grid_resize(SpatialGrid *grid, int world_w, int world_h, int cell_w, int cell_h, int reach)
+{
     grid->cell_height = cell_h;
     grid->cell_width = cell_w;
 
     grid->world_height = world_h;
     grid->world_width = world_w;
 
-    grid->rows = world_h / cell_h;
-    grid->columns = world_w / cell_w;
+    if (reach < 1)
+        reach = 1;
+    if (reach > GRID_MAX_REACH)
+        reach = GRID_MAX_REACH;
+    grid->reach = reach;
+
+    // round up, so a world that isn't a multiple of the cell size still gets covered
+    grid->rows = (world_h + cell_h - 1) / cell_h;
+    grid->columns = (world_w + cell_w - 1) / cell_w;
+
+    int cells = grid->rows * grid->columns;
+
+    // one count per cell, plus one extra offset so cell_start[cell + 1] is always the end of a cell
+    free(grid->cell_count);
+    free(grid->cell_start);
+    free(grid->cell_capacity);
+    grid->cell_count = calloc(cells, sizeof(int));
+    grid->cell_start = calloc(cells + 1, sizeof(int));
+    grid->cell_capacity = calloc(cells, sizeof(int));
+
+    grid->inserted = 0;
+    grid->sorted = true;
+    grid->incremental = false;
+}
 
-    // create an array of pointers
-    grid->cells = malloc(grid->rows * sizeof(CircleList *));
+// Rough relative costs for the cell size model, in units of one candidate pair test.
+#define GRID_COST_PER_CELL 2.0          // clearing and prefix-summing a cell every step
+#define GRID_COST_PER_NEIGHBOURHOOD 4.0 // looking up one row span of a neighbourhood
 
-    // grid->cells currently looks like
-    // [ row1_ptr, row2_ptr, ... ]
-    // these are pointers to arrays that we haven't initialised yet.
+// Fills in reach and estimated_pairs for one cell size and returns its estimated cost, or -1 if it's too small to use.
+double grid_estimate_cell_size(GridCellChoice *choice, int size, int diameter, int count, int world_w, int world_h)
+{
+    if (size < 1)
+        size = 1;
+
+    int reach = (diameter + size - 1) / size;
+    if (reach < 1)
+        reach = 1;
+    if (reach > GRID_MAX_REACH)
+        return -1.0;
+
+    double density = count / ((double)world_w * world_h);
+    double rows = (world_h + size - 1) / size;
+    double columns = (world_w + size - 1) / size;
+    double cells = rows * columns;
+    double occupied = cells < count ? cells : count;
+    double span = (2 * reach + 1) * (double)size;
+
+    // every circle tests everything in its search block, each pair once
+    double pairs = count * density * span * span / 2.0;
+
+    choice->cell_size = size;
+    choice->reach = reach;
+    choice->estimated_pairs = pairs;
+    return pairs + cells * GRID_COST_PER_CELL + occupied * (2 * reach + 1) * GRID_COST_PER_NEIGHBOURHOOD;
+}
+
+GridCellChoice grid_choose_cell_size(const float *radius, int count, int world_w, int world_h, int fixed_size, float margin)
+{
+    GridCellChoice best = {0, 1, 0.0};
+    double best_cost = -1.0;
 
-    // loop through each of the row pointers above
-    for (int i = 0; i < grid->rows; i++)
+    float max_radius = 1.0f;
+    for (int i = 0; i < count; i++)
     {
-        // for every pointer, we malloc an actual array of cells - a CircleList for every column in the row
-        grid->cells[i] = malloc(grid->columns * sizeof(CircleList));
+        if (radius[i] > max_radius)
+            max_radius = radius[i];
+    }
 
-        // so now, we know that:
-        // grid->cells[0] is a pointer to the array of columns in the first row
-        // grid->cells[0] = [col1, col2, ...]
+    // two circles can only touch (or come within margin of touching) if their centres are closer than this
+    int diameter = (int)ceilf(max_radius * 2.0f + margin);
 
-        for (int j = 0; j < grid->columns; j++)
+    if (fixed_size > 0)
+    {
+        // too small for GRID_MAX_REACH to cover the biggest circle, so use the smallest size that can
+        if (grid_estimate_cell_size(&best, fixed_size, diameter, count, world_w, world_h) < 0.0)
+            grid_estimate_cell_size(&best, (diameter + GRID_MAX_REACH - 1) / GRID_MAX_REACH, diameter, count, world_w, world_h);
+        return best;
+    }
+
+    // small cells with a wide search (diameter / reach), then ever bigger cells with a 3x3 search
+    int candidates[GRID_MAX_REACH + 6];
+    int candidate_count = 0;
+    for (int reach = GRID_MAX_REACH; reach >= 1; reach--)
+        candidates[candidate_count++] = (diameter + reach - 1) / reach;
+    float multiples[] = {1.5f, 2.0f, 3.0f, 4.0f, 6.0f, 8.0f};
+    for (int m = 0; m < 6; m++)
+        candidates[candidate_count++] = (int)(diameter * multiples[m]);
+
+    for (int c = 0; c < candidate_count; c++)
+    {
+        GridCellChoice choice;
+        double cost = grid_estimate_cell_size(&choice, candidates[c], diameter, count, world_w, world_h);
+
+        if (cost >= 0.0 && (best_cost < 0.0 || cost < best_cost))
         {
-            grid->cells[i][j].head = NULL;
-            grid->cells[i][j].count = 0;
+            best = choice;
+            best_cost = cost;
         }
     }
 
-    return grid;
+    return best;
+}
+
+// Make sure the per-circle arrays can hold circle_count circles.
+// This only allocates when the population outgrows what we've seen before.
+void grid_reserve(SpatialGrid *grid, int circle_count)
+{
+    if (circle_count <= grid->circle_count)
+        return;
+
+    grid->circle_count = circle_count;
+    grid->pending = realloc(grid->pending, circle_count * sizeof(int));
+    grid->pending_cell = realloc(grid->pending_cell, circle_count * sizeof(int));
+    grid->circle_cell = realloc(grid->circle_cell, circle_count * sizeof(int));
+    grid->circle_position = realloc(grid->circle_position, circle_count * sizeof(int));
+
+    if (circle_count > grid->storage_capacity)
+    {
+        grid->storage_capacity = circle_count;
+        grid->circles = realloc(grid->circles, circle_count * sizeof(int));
+    }
 }
 
 void grid_clear(SpatialGrid *grid)
 {
-    for (int i = 0; i < grid->rows; i++)
+    // nothing to free, just forget what was inserted. O(cells).
+    memset(grid->cell_count, 0, grid->rows * grid->columns * sizeof(int));
+    grid->inserted = 0;
+    grid->incremental = false;
+
+    // cell_start still describes last frame, so the next query has to redo the (now empty) sort
+    grid->sorted = false;
+}
+
+void grid_insert(SpatialGrid *grid, int circle, float x, float y)
+{
+    if (grid->inserted == grid->circle_count)
+        grid_reserve(grid, grid->circle_count * 2 + 1);
+
+    int row = get_circle_row(grid, y);
+    int col = get_circle_column(grid, x);
+    int cell = row * grid->columns + col;
+
+    grid->pending[grid->inserted] = circle;
+    grid->pending_cell[grid->inserted] = cell;
+    grid->inserted++;
+
+    grid->cell_count[cell]++;
+    grid->sorted = false;
+}
+
+// Counting sort of the pending circles into grid->circles.
+// The counts were already tallied by grid_insert, so this is a prefix sum then a scatter.
+// The scatter walks the circles in insertion order, so circles keep their insertion order within a cell.
+void grid_sort(SpatialGrid *grid)
+{
+    if (grid->sorted)
+        return;
+
+    int cells = grid->rows * grid->columns;
+
+    grid->cell_start[0] = 0;
+    for (int cell = 0; cell < cells; cell++)
+        grid->cell_start[cell + 1] = grid->cell_start[cell] + grid->cell_count[cell];
+
+    // cell_start[cell + 1] doubles as a write cursor: fill each cell from its end, walking backwards
+    // through the pending circles. Once the scatter is done every cursor is back at its cell's start.
+    for (int i = grid->inserted - 1; i >= 0; i--)
     {
-        for (int j = 0; j < grid->columns; j++)
-        {
-            CircleNode *current = grid->cells[i][j].head;
-            while (current != NULL)
-            {
-                CircleNode *next = current->next;
-                free(current);
-                current = next;
-            }
+        int cell = grid->pending_cell[i];
+        grid->cell_start[cell + 1]--;
+        grid->circles[grid->cell_start[cell + 1]] = grid->pending[i];
+    }
+
+    // shift the cursors back to the end of each cell
+    for (int cell = 0; cell < cells; cell++)
+        grid->cell_start[cell + 1] += grid->cell_count[cell];
+
+    grid->sorted = true;
+}
+
+void grid_build(SpatialGrid *grid, const float *x, const float *y, int count, ThreadPool *pool, GridChunkTask before_chunk, void *context)
+{
+    grid_reserve(grid, count);
+
+    int cells = grid->rows * grid->columns;
+    int threads = pool ? pool->thread_count : 1;
+
+    // a few thousand circles aren't worth waking the other threads for
+    GridBuild build;
+    build.chunk_count = count < 4096 ? 1 : threads;
+
+    // chunks are whole cache lines of floats, so two threads never write to the same line of x or y
+    build.chunk_size = ((count + build.chunk_count - 1) / build.chunk_count + 15) & ~15;
+    if (build.chunk_size == 0)
+        build.chunk_size = 16;
+    build.chunk_count = (count + build.chunk_size - 1) / build.chunk_size;
+    if (build.chunk_count < 1)
+        build.chunk_count = 1;
+    build.range_size = (cells + build.chunk_count - 1) / build.chunk_count;
+
+    if (build.chunk_count * cells > grid->chunk_capacity)
+    {
+        grid->chunk_capacity = build.chunk_count * cells;
+        free(grid->chunk_cells);
+        grid->chunk_cells = malloc(grid->chunk_capacity * sizeof(int));
+    }
+
+    int range_start[build.chunk_count + 1];
+    build.grid = grid;
+    build.x = x;
+    build.y = y;
+    build.count = count;
+    build.range_start = range_start;
+    build.before_chunk = before_chunk;
+    build.context = context;
+
+    // 1. each chunk counts its own circles into its own row of chunk_cells
+    // 2. each range of cells adds up the chunks' counts, which gives the cell counts and the range totals
+    // 3. the range totals are summed here, one per range, so each range knows where it starts
+    // 4. each range turns its chunks' counts into where each chunk starts writing in each cell
+    // 5. each chunk scatters its circles. chunk 0's circles come first in every cell, then chunk 1's and so on,
+    //    so the result is exactly what inserting them one by one would give.
+    if (pool)
+    {
+        pool_run(pool, build.chunk_count, grid_build_count, &build);
+        pool_run(pool, build.chunk_count, grid_build_sum, &build);
+    }
+    else
+    {
+        grid_build_count(&build, 0, 0);
+        grid_build_sum(&build, 0, 0);
+    }
+
+    int total = 0;
+    for (int range = 0; range < build.chunk_count; range++)
+    {
+        int range_total = range_start[range];
+        range_start[range] = total;
+        total += range_total;
+    }
+
+    if (pool)
+    {
+        pool_run(pool, build.chunk_count, grid_build_offsets, &build);
+        pool_run(pool, build.chunk_count, grid_build_scatter, &build);
+    }
+    else
+    {
+        grid_build_offsets(&build, 0, 0);
+        grid_build_scatter(&build, 0, 0);
+    }
+
+    grid->cell_start[cells] = count;
+    grid->inserted = count;
+    grid->sorted = true;
+    grid->incremental = false;
+}
 
-            grid->cells[i][j].head = NULL;
-            grid->cells[i][j].count = 0;
+void grid_build_count(void *context, int chunk, int worker)
+{
+    (void)worker;
+    GridBuild *build = context;
+    SpatialGrid *grid = build->grid;
+    int *counts = &grid->chunk_cells[chunk * grid->rows * grid->columns];
+
+    int begin = chunk * build->chunk_size;
+    int end = begin + build->chunk_size < build->count ? begin + build->chunk_size : build->count;
+
+    if (build->before_chunk)
+        build->before_chunk(build->context, begin, end);
+
+    memset(counts, 0, grid->rows * grid->columns * sizeof(int));
+    for (int i = begin; i < end; i++)
+    {
+        int cell = get_circle_row(grid, build->y[i]) * grid->columns + get_circle_column(grid, build->x[i]);
+        grid->pending[i] = i;
+        grid->pending_cell[i] = cell;
+        counts[cell]++;
+    }
+}
+
+void grid_build_sum(void *context, int range, int worker)
+{
+    (void)worker;
+    GridBuild *build = context;
+    SpatialGrid *grid = build->grid;
+    int cells = grid->rows * grid->columns;
+
+    int begin = range * build->range_size;
+    int end = begin + build->range_size < cells ? begin + build->range_size : cells;
+
+    int range_total = 0;
+    for (int cell = begin; cell < end; cell++)
+    {
+        int cell_total = 0;
+        for (int chunk = 0; chunk < build->chunk_count; chunk++)
+            cell_total += grid->chunk_cells[chunk * cells + cell];
+
+        grid->cell_count[cell] = cell_total;
+        range_total += cell_total;
+    }
+    build->range_start[range] = range_total;
+}
+
+void grid_build_offsets(void *context, int range, int worker)
+{
+    (void)worker;
+    GridBuild *build = context;
+    SpatialGrid *grid = build->grid;
+    int cells = grid->rows * grid->columns;
+
+    int begin = range * build->range_size;
+    int end = begin + build->range_size < cells ? begin + build->range_size : cells;
+
+    int offset = build->range_start[range];
+    for (int cell = begin; cell < end; cell++)
+    {
+        grid->cell_start[cell] = offset;
+        for (int chunk = 0; chunk < build->chunk_count; chunk++)
+        {
+            int chunk_count = grid->chunk_cells[chunk * cells + cell];
+            grid->chunk_cells[chunk * cells + cell] = offset;
+            offset += chunk_count;
         }
     }
 }
-void grid_insert(SpatialGrid *grid, Circle *circle)
+
+void grid_build_scatter(void *context, int chunk, int worker)
 {
-    int row = get_circle_row(grid, circle);
-    int col = get_circle_column(grid, circle);
+    (void)worker;
+    GridBuild *build = context;
+    SpatialGrid *grid = build->grid;
+    int *cursors = &grid->chunk_cells[chunk * grid->rows * grid->columns];
 
-    CircleNode *new_node = malloc(sizeof(CircleNode));
-    new_node->circle = circle;
-    new_node->next = NULL;
+    int begin = chunk * build->chunk_size;
+    int end = begin + build->chunk_size < build->count ? begin + build->chunk_size : build->count;
+
+    for (int i = begin; i < end; i++)
+        grid->circles[cursors[grid->pending_cell[i]]++] = i;
+}
 
-    if (grid->cells[row][col].head == NULL)
+void grid_build_incremental(SpatialGrid *grid, const float *x, const float *y, int count)
+{
+    grid_reserve(grid, count);
+    int cells = grid->rows * grid->columns;
+
+    memset(grid->cell_count, 0, cells * sizeof(int));
+    for (int i = 0; i < count; i++)
     {
-        grid->cells[row][col].head = new_node;
-        grid->cells[row][col].count = 1;
-        return;
+        int cell = get_circle_row(grid, y[i]) * grid->columns + get_circle_column(grid, x[i]);
+        grid->circle_cell[i] = cell;
+        grid->cell_count[cell]++;
+    }
+
+    // every cell gets room to spare, even the empty ones, so a circle can always move in without a rebuild
+    int offset = 0;
+    for (int cell = 0; cell < cells; cell++)
+    {
+        grid->cell_capacity[cell] = grid->cell_count[cell] + grid->cell_count[cell] / 4 + GRID_CELL_SLACK;
+        grid->cell_start[cell] = offset;
+        offset += grid->cell_capacity[cell];
+    }
+    grid->cell_start[cells] = offset;
+
+    if (offset > grid->storage_capacity)
+    {
+        grid->storage_capacity = offset;
+        grid->circles = realloc(grid->circles, offset * sizeof(int));
+    }
+
+    // cell_count doubles as the fill cursor, so count it up again from 0
+    memset(grid->cell_count, 0, cells * sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        int cell = grid->circle_cell[i];
+        int position = grid->cell_start[cell] + grid->cell_count[cell]++;
+        grid->circles[position] = i;
+        grid->circle_position[i] = position;
+    }
+
+    grid->inserted = count;
+    grid->sorted = true;
+    grid->incremental = true;
+    grid->relinked = count;
+    grid->incremental_builds++;
+}
+
+int grid_update_incremental(SpatialGrid *grid, const float *x, const float *y, int count)
+{
+    if (!grid->incremental || grid->inserted != count)
+        return -1;
+
+    int relinked = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int cell = get_circle_row(grid, y[i]) * grid->columns + get_circle_column(grid, x[i]);
+        int old_cell = grid->circle_cell[i];
+        if (cell == old_cell)
+            continue;
+
+        if (grid->cell_count[cell] == grid->cell_capacity[cell])
+        {
+            grid->incremental = false;
+            return -1;
+        }
+
+        // out of the old cell: its last circle takes over the slot, so nothing else in the cell moves.
+        // cells don't need to stay in any order, the collider's c1 < c2 check finds each pair once either way
+        int position = grid->circle_position[i];
+        int last = grid->cell_start[old_cell] + --grid->cell_count[old_cell];
+        int moved = grid->circles[last];
+        grid->circles[position] = moved;
+        grid->circle_position[moved] = position;
+
+        // onto the end of the new one
+        position = grid->cell_start[cell] + grid->cell_count[cell]++;
+        grid->circles[position] = i;
+        grid->circle_position[i] = position;
+        grid->circle_cell[i] = cell;
+        relinked++;
     }
-    CircleNode *current = grid->cells[row][col].head;
-    while (current->next != NULL)
-        current = current->next;
 
-    current->next = new_node;
-    grid->cells[row][col].count++;
+    grid->relinked = relinked;
+    return relinked;
 }
 
-// TODO: Get it by cell, not by circle
-void grid_get_nearby_circles(SpatialGrid *grid, Circle *circle, CircleList *out)
+void grid_get_neighbourhood(SpatialGrid *grid, int row, int col, GridNeighbourhood *out)
 {
-    out->head = NULL;
-    out->count = 0;
+    out->span_count = 0;
 
-    int circle_row_index = get_circle_row(grid, circle);
-    int circle_col_index = get_circle_column(grid, circle);
+    grid_sort(grid);
 
-    // one behind, one in front
-    for (int row_offset = -1; row_offset <= 1; row_offset++)
+    // reach cells behind, reach in front (clamped to the edge of the grid)
+    int first_col = col - grid->reach > 0 ? col - grid->reach : 0;
+    int last_col = col + grid->reach < grid->columns - 1 ? col + grid->reach : grid->columns - 1;
+
+    if (grid->incremental)
     {
-        // one above, one below
-        for (int col_offset = -1; col_offset <= 1; col_offset++)
+        // the spare room at the end of each cell isn't circles, so every cell is its own span
+        for (int check_row = row - grid->reach; check_row <= row + grid->reach; check_row++)
         {
-            // row/col indexes to check
-            int check_row = circle_row_index + row_offset;
-            int check_col = circle_col_index + col_offset;
+            if (check_row < 0 || check_row >= grid->rows)
+                continue;
 
-            if (check_row >= 0 && check_row < grid->rows &&
-                check_col >= 0 && check_col < grid->columns)
+            for (int check_col = first_col; check_col <= last_col; check_col++)
             {
-                if(grid->cells[check_row][check_col].count == 0)
+                int cell = check_row * grid->columns + check_col;
+                if (grid->cell_count[cell] == 0)
                     continue;
 
-                CircleNode* current = grid->cells[check_row][check_col].head;
-                while(current != NULL)
-                {
-                    CircleNode* new_node = malloc(sizeof(CircleNode));
-                    new_node->circle = current->circle;
-                    new_node->next = out->head;
-                    out->head = new_node;
-                    out->count++;
-
-                    current = current->next;
-                }
+                out->spans[out->span_count].begin = &grid->circles[grid->cell_start[cell]];
+                out->spans[out->span_count].end = out->spans[out->span_count].begin + grid->cell_count[cell];
+                out->span_count++;
             }
         }
+        return;
+    }
+
+    // reach above, reach below
+    for (int check_row = row - grid->reach; check_row <= row + grid->reach; check_row++)
+    {
+        if (check_row < 0 || check_row >= grid->rows)
+            continue;
+
+        // the cells first_col..last_col of this row are stored back to back,
+        // so they're one span from the start of the first to the start of the one after the last.
+        int row_start = check_row * grid->columns;
+        int start = grid->cell_start[row_start + first_col];
+        int end = grid->cell_start[row_start + last_col + 1];
+
+        if (start == end)
+            continue;
+
+        out->spans[out->span_count].begin = &grid->circles[start];
+        out->spans[out->span_count].end = &grid->circles[end];
+        out->span_count++;
     }
 }
 
-int get_circle_row(SpatialGrid *grid, Circle *circle)
+CircleSpan grid_get_cell(SpatialGrid *grid, int row, int col)
 {
-    int row = (int)(circle->position[1] / grid->cell_height);
+    grid_sort(grid);
+
+    int cell = row * grid->columns + col;
+    CircleSpan span;
+    span.begin = &grid->circles[grid->cell_start[cell]];
+    span.end = span.begin + grid->cell_count[cell];
+    return span;
+}
+
+void grid_cell_of(SpatialGrid *grid, float x, float y, int *row, int *col)
+{
+    *row = get_circle_row(grid, y);
+    *col = get_circle_column(grid, x);
+}
+
+int grid_cell_count(SpatialGrid *grid, int row, int col)
+{
+    return grid->cell_count[row * grid->columns + col];
+}
+
+void grid_get_occupancy(SpatialGrid *grid, int *occupied_cells, int *max_occupancy)
+{
+    *occupied_cells = 0;
+    *max_occupancy = 0;
+
+    for (int cell = 0; cell < grid->rows * grid->columns; cell++)
+    {
+        if (grid->cell_count[cell] > 0)
+            (*occupied_cells)++;
+        if (grid->cell_count[cell] > *max_occupancy)
+            *max_occupancy = grid->cell_count[cell];
+    }
+}
+
+int get_circle_row(SpatialGrid *grid, float y)
+{
+    int row = (int)(y / grid->cell_height);
 
     // Clamp to valid bounds
     if (row < 0)
@@ -144,9 +592,9 @@ int get_circle_row(SpatialGrid *grid, Circle *circle)
     return row;
 }
 
-int get_circle_column(SpatialGrid *grid, Circle *circle)
+int get_circle_column(SpatialGrid *grid, float x)
 {
-    int col = (int)(circle->position[0] / grid->cell_width);
+    int col = (int)(x / grid->cell_width);
 
     // Clamp to valid bounds
     if (col < 0)
@@ -161,14 +609,15 @@ void grid_destroy(SpatialGrid *grid)
 {
     if (grid)
     {
-        // Free each row
-        for (int i = 0; i < grid->rows; i++)
-        {
-            free(grid->cells[i]);
-        }
-
-        // Free the array of row pointers
-        free(grid->cells);
+        free(grid->cell_count);
+        free(grid->cell_start);
+        free(grid->pending);
+        free(grid->pending_cell);
+        free(grid->circles);
+        free(grid->chunk_cells);
+        free(grid->cell_capacity);
+        free(grid->circle_cell);
+        free(grid->circle_position);
 
         // Free the grid itself
         free(grid);
@@ -1,38 +1,129 @@
 #ifndef SPATIAL_GRID_H
 #define SPATIAL_GRID_H
 
-#include "../circle/circle.h"
+#include <stdbool.h>
+#include <stdint.h>
 
-struct CircleNode;
+#include "../thread_pool/thread_pool.h"
 
-typedef struct CircleNode
+// A contiguous run of circle indexes inside the grid's storage, [begin, end).
+typedef struct
+{
+    int* begin;
+    int* end;
+} CircleSpan;
+
+// How many cells either side of a circle's own cell have to be searched.
+// 1 (a 3x3 block) is enough while cells are at least as big as the biggest circle,
+// smaller cells need a wider block so big circles still find everything they touch.
+#define GRID_MAX_REACH 4
+
+// The circles in a (2 * reach + 1) square block of cells. Cells in the same row sit next to each other in storage,
+// so the whole block is at most one span per row and nothing has to be copied.
+// An incremental grid has gaps between its cells, so there it's one span per cell instead.
+typedef struct
 {
-    Circle* circle;
-    struct CircleNode* next;
-} CircleNode;
+    CircleSpan spans[(2 * GRID_MAX_REACH + 1) * (2 * GRID_MAX_REACH + 1)];
+    int span_count;
+} GridNeighbourhood;
 
+// Room an incremental grid leaves in each cell on top of what's in it: this many slots, plus a quarter of its count.
+#define GRID_CELL_SLACK 8
+
+// What grid_choose_cell_size settled on, kept around so it can be compared with what really happens.
 typedef struct
 {
-    CircleNode* head;
-    int count;
-} CircleList;
+    int cell_size;
+    int reach;
+    double estimated_pairs; // candidate pair tests per step the cost model expected
+} GridCellChoice;
+
+// Called by grid_build on each chunk of circles [begin, end) just before it works out their cells,
+// so whatever has to happen to them first (like moving) happens while they're in cache, on the same thread.
+typedef void (*GridChunkTask)(void* context, int begin, int end);
 
+// The grid uses a counting-sort layout rather than a linked list per cell.
+// grid_insert only records which cell a circle belongs in (and bumps that cell's count),
+// then the first query after an insert sorts every recorded circle into one flat array
+// where each cell is a contiguous run: circles[cell_start[cell] .. cell_start[cell] + cell_count[cell]).
+// Nothing is allocated or freed per frame once the arrays are big enough for the population.
 typedef struct
 {
-    int circle_count;
+    int circle_count; // capacity of the per-circle arrays, grows if more circles are inserted
     int rows;
     int columns;
     int cell_width;
     int cell_height;
     int world_width;
     int world_height;
-    CircleList** cells; // 2D array for every cell
+    int reach; // cells searched either side, see GRID_MAX_REACH
+
+    int inserted;       // circles inserted since the last grid_clear
+    bool sorted;        // false until the inserted circles have been sorted into cells
+    int* pending;       // circle indexes in insertion order
+    int* pending_cell;  // cell index for each pending circle
+    int* cell_count;    // rows * columns, circles in each cell
+    int* cell_start;    // rows * columns + 1, offset of each cell in circles
+    int* circles;       // inserted circle indexes, sorted by cell
+
+    int chunk_capacity; // ints allocated for chunk_cells
+    int* chunk_cells;   // grid_build's cell counts for each chunk of circles, then where each chunk writes in each cell
+
+    // Incremental layout, see grid_build_incremental. Only meaningful while incremental is true.
+    bool incremental;
+    int storage_capacity; // ints allocated for circles, counting the gaps
+    int* cell_capacity;   // rows * columns, slots each cell has, cell_start[cell] + cell_capacity[cell] is the next cell's start
+    int* circle_cell;     // circle_count, the cell each circle is in
+    int* circle_position; // circle_count, where each circle is in circles
+    int relinked;         // circles that changed cell in the last grid_update_incremental
+    int64_t incremental_builds; // times grid_build_incremental has laid the grid out from scratch
 } SpatialGrid;
 
-SpatialGrid* grid_create(int circle_count, int world_w, int world_h, int cell_w, int cell_h);
+// Cells don't have to divide the world evenly, the last row/column just hangs over the edge.
+SpatialGrid* grid_create(int circle_count, int world_w, int world_h, int cell_w, int cell_h, int reach);
+// Changes the world or cell size. Empties the grid, so insert everything again afterwards.
+void grid_resize(SpatialGrid* grid, int world_w, int world_h, int cell_w, int cell_h, int reach);
+// Picks a cell size for these circles from the biggest diameter and how densely they fill the world,
+// trading candidate pair tests against the per-cell cost of more, smaller cells.
+// Pass fixed_size > 0 to skip the search and just get the reach and estimate for that size.
+// margin widens the distance pairs have to be found within, e.g. a neighbour list's skin. 0 for plain contacts.
+GridCellChoice grid_choose_cell_size(const float* radius, int count, int world_w, int world_h, int fixed_size, float margin);
 void grid_clear(SpatialGrid* grid);
-void grid_insert(SpatialGrid* grid, Circle* circle);
-void grid_get_nearby_circles(SpatialGrid* grid, Circle* circle, CircleList* out);
+// The grid only stores the circle's index, it doesn't need to know anything else about it.
+void grid_insert(SpatialGrid* grid, int circle, float x, float y);
+// Sorts everything inserted since the last sort into its cell. Queries do this for you.
+void grid_sort(SpatialGrid* grid);
+// Empties the grid and fills it with circles 0..count-1 at (x[i], y[i]), sorted and ready to query.
+// Same result as grid_clear, grid_insert for each circle in order and grid_sort, but the work is split
+// over the pool's threads (pool can be NULL): each thread takes a chunk of circles and counts its cells,
+// a prefix sum over every chunk's counts tells each chunk where to write, then each scatters its own chunk.
+// before_chunk (can be NULL) runs on each chunk first, with context.
+void grid_build(SpatialGrid* grid, const float* x, const float* y, int count, ThreadPool* pool, GridChunkTask before_chunk, void* context);
+// Incremental mode: instead of sorting every circle into place every step, each cell gets a little room to spare
+// (GRID_CELL_SLACK) and the grid remembers which cell each circle is in and where. After the circles move,
+// grid_update_incremental only touches the ones that crossed into another cell: the old cell's last circle fills
+// the slot it leaves, and it goes on the end of the new cell, so each move is O(1) however full the cells are.
+// Cells end up in no particular order, unlike after grid_build.
+// Most circles stay put from one step to the next, so the work beyond working out each circle's cell scales
+// with the circles crossing cell edges, not the population.
+// The gaps cost the collider: a neighbourhood is a span per cell rather than per row, and the circles are spread
+// over more memory. It pays off with big cells and slow circles, where building is a real share of the step.
+//
+// Lays circles 0..count-1 out from scratch with room to spare in every cell.
+void grid_build_incremental(SpatialGrid* grid, const float* x, const float* y, int count);
+// Moves the circles whose cell has changed since the last build or update, and returns how many there were.
+// Returns -1 if it can't: the grid isn't laid out incrementally for count circles, or a cell ran out of room.
+// Then some circles may already have moved, call grid_build_incremental before reading the grid.
+// The circles have to be the same ones at the same indexes as last time, see CircleStore.layout_version.
+int grid_update_incremental(SpatialGrid* grid, const float* x, const float* y, int count);
+// Points out at the circles within grid->reach cells of (row, col). The spans are only valid until the next grid_clear or grid_insert.
+void grid_get_neighbourhood(SpatialGrid* grid, int row, int col, GridNeighbourhood* out);
+CircleSpan grid_get_cell(SpatialGrid* grid, int row, int col);
+// Which cell a point falls in. Points outside the world land in the nearest edge cell.
+void grid_cell_of(SpatialGrid* grid, float x, float y, int* row, int* col);
+int grid_cell_count(SpatialGrid* grid, int row, int col);
+// How many cells have anything in them, and the most circles in any one cell. Walks every cell.
+void grid_get_occupancy(SpatialGrid* grid, int* occupied_cells, int* max_occupancy);
 void grid_destroy(SpatialGrid* grid);
 
 #endif
@@ -0,0 +1,130 @@
+#include "spatial_order.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// private prototypes
+void spatial_order_reserve(SpatialOrder* order, CircleStore* circles);
+uint32_t spatial_order_morton(uint32_t col, uint32_t row);
+uint32_t spatial_order_spread_bits(uint32_t value);
+
+SpatialOrder* spatial_order_create(float threshold, float cell_size)
+{
+    SpatialOrder* order = malloc(sizeof(SpatialOrder));
+    memset(order, 0, sizeof(SpatialOrder));
+    order->threshold = threshold;
+    order->cell_size = cell_size > 1.0f ? cell_size : 1.0f;
+    order->scatter = 1.0f; // nothing's been measured yet
+    return order;
+}
+
+bool spatial_order_update(SpatialOrder* order, CircleStore* circles)
+{
+    order->checks++;
+
+    float near = SPATIAL_ORDER_NEAR_CELLS * order->cell_size;
+    int scattered = 0;
+    for (int i = 1; i < circles->count; i++)
+    {
+        float dx = circles->x[i] - circles->x[i - 1];
+        float dy = circles->y[i] - circles->y[i - 1];
+        scattered += dx > near || dx < -near || dy > near || dy < -near;
+    }
+    order->scatter = circles->count > 1 ? (float)scattered / (circles->count - 1) : 0.0f;
+
+    if (order->scatter <= order->threshold)
+        return false;
+
+    spatial_order_apply(order, circles);
+    return true;
+}
+
+void spatial_order_apply(SpatialOrder* order, CircleStore* circles)
+{
+    spatial_order_reserve(order, circles);
+    int count = circles->count;
+
+    // 16 bits a side. anything off the edges of that (or of the world) is clamped onto the edge cells
+    float scale = 1.0f / order->cell_size;
+    for (int i = 0; i < count; i++)
+    {
+        float col = circles->x[i] * scale;
+        float row = circles->y[i] * scale;
+        uint32_t c = col <= 0.0f ? 0 : (col >= 65535.0f ? 65535 : (uint32_t)col);
+        uint32_t r = row <= 0.0f ? 0 : (row >= 65535.0f ? 65535 : (uint32_t)row);
+        order->keys[i] = ((uint64_t)spatial_order_morton(c, r) << 32) | (uint32_t)i;
+    }
+
+    // LSD radix sort on the Morton half, a byte at a time. Each pass is stable and the keys start in index order,
+    // so circles in the same cell keep the order they were in.
+    uint64_t* from = order->keys;
+    uint64_t* to = order->scratch;
+    for (int shift = 32; shift < 64; shift += 8)
+    {
+        int offsets[256] = {0};
+        for (int i = 0; i < count; i++)
+            offsets[(from[i] >> shift) & 0xff]++;
+
+        int total = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            int digit_count = offsets[digit];
+            offsets[digit] = total;
+            total += digit_count;
+        }
+
+        for (int i = 0; i < count; i++)
+            to[offsets[(from[i] >> shift) & 0xff]++] = from[i];
+
+        uint64_t* swap = from;
+        from = to;
+        to = swap;
+    }
+
+    // four passes, so the sorted keys are back in keys
+    for (int i = 0; i < count; i++)
+        order->order[i] = (int)(from[i] & 0xffffffff);
+
+    circle_store_permute(circles, order->order);
+    order->scatter = 0.0f;
+    order->reorders++;
+}
+
+void spatial_order_reserve(SpatialOrder* order, CircleStore* circles)
+{
+    if (circles->count <= order->capacity)
+        return;
+
+    order->capacity = circles->capacity;
+    order->keys = realloc(order->keys, order->capacity * sizeof(uint64_t));
+    order->scratch = realloc(order->scratch, order->capacity * sizeof(uint64_t));
+    order->order = realloc(order->order, order->capacity * sizeof(int));
+}
+
+// Interleaves the bits, column in the even ones and row in the odd ones, so cells close in both directions get close keys.
+uint32_t spatial_order_morton(uint32_t col, uint32_t row)
+{
+    return spatial_order_spread_bits(col) | (spatial_order_spread_bits(row) << 1);
+}
+
+// 16 bits out to every other bit of 32
+uint32_t spatial_order_spread_bits(uint32_t value)
+{
+    value &= 0x0000ffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+void spatial_order_destroy(SpatialOrder* order)
+{
+    if (order)
+    {
+        free(order->keys);
+        free(order->scratch);
+        free(order->order);
+        free(order);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SPATIAL_ORDER_H
+#define SPATIAL_ORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../circle/circle.h"
+
+// Steps between looks at how scattered the store has become.
+#define SPATIAL_ORDER_CHECK_STEPS 16
+// Circles next to each other in the store count as scattered when they're more than this many cells apart
+// along either axis. A neighbourhood search touches the cells around a circle, so past that they share nothing.
+#define SPATIAL_ORDER_NEAR_CELLS 8
+
+// Keeps circles that are close together in the world close together in the store.
+// Placement puts circles at random spots, so without this, neighbours in space sit at random indexes and every
+// neighbourhood the collider visits pulls in cache lines from all over the arrays.
+//
+// Each circle gets the Morton (Z-order) key of the cell it's in, cells about one diameter across. Sorting by that
+// key puts each cell's circles next to each other, and nearby cells mostly nearby too.
+// As circles move the order decays. scatter is the fraction of circles that are more than SPATIAL_ORDER_NEAR_CELLS
+// cells from the one before them in the store: a few percent right after a sort (the curve jumps at block edges),
+// close to 1 for a random order. Once it goes past the threshold the store is sorted again.
+typedef struct
+{
+    float threshold;
+    float cell_size;
+
+    int capacity;
+    uint64_t* keys;    // (Morton key << 32) | index, sorted to get the new order
+    uint64_t* scratch; // the radix sort's other buffer
+    int* order;
+
+    float scatter; // at the last check
+    int64_t checks;
+    int64_t reorders;
+} SpatialOrder;
+
+// threshold is the scatter (0 to 1) that triggers a sort. cell_size should be about the biggest diameter.
+SpatialOrder* spatial_order_create(float threshold, float cell_size);
+// Measures the scatter and sorts the store if it's past the threshold. Returns true if it sorted.
+// Sorting changes the store's layout_version, so anything that holds indexes starts over by itself.
+bool spatial_order_update(SpatialOrder* order, CircleStore* circles);
+// Sorts the store no matter how ordered it already is.
+void spatial_order_apply(SpatialOrder* order, CircleStore* circles);
+void spatial_order_destroy(SpatialOrder* order);
+
+#endif
@@ -0,0 +1,96 @@
+#include "sweep_and_prune.h"
+
+#include <stdlib.h>
+
+// private prototypes
+void sap_reset(SweepAndPrune* sap, CircleStore* circles);
+void sap_refresh_boxes(SweepAndPrune* sap, CircleStore* circles);
+int sap_compare_entries(const void* a, const void* b);
+
+SweepAndPrune* sap_create(int capacity)
+{
+    SweepAndPrune* sap = malloc(sizeof(SweepAndPrune));
+    sap->count = 0;
+    sap->capacity = capacity;
+    sap->entries = malloc(capacity * sizeof(SapEntry));
+    sap->swaps = 0;
+    sap->layout_version = -1;
+    return sap;
+}
+
+void sap_update(SweepAndPrune* sap, CircleStore* circles)
+{
+    if (sap->count != circles->count || sap->layout_version != circles->layout_version)
+    {
+        sap_reset(sap, circles);
+        return;
+    }
+
+    sap_refresh_boxes(sap, circles);
+
+    // insertion sort. almost everything is already in place, so this is mostly one comparison per entry.
+    int64_t swaps = 0;
+    for (int i = 1; i < sap->count; i++)
+    {
+        SapEntry entry = sap->entries[i];
+        int j = i - 1;
+        while (j >= 0 && sap->entries[j].min_x > entry.min_x)
+        {
+            sap->entries[j + 1] = sap->entries[j];
+            j--;
+        }
+        sap->entries[j + 1] = entry;
+        swaps += i - 1 - j;
+    }
+    sap->swaps = swaps;
+}
+
+// New or different circles, so there's no order worth keeping. Sort the lot properly once.
+void sap_reset(SweepAndPrune* sap, CircleStore* circles)
+{
+    if (circles->count > sap->capacity)
+    {
+        sap->capacity = circles->count;
+        sap->entries = realloc(sap->entries, sap->capacity * sizeof(SapEntry));
+    }
+
+    sap->count = circles->count;
+    sap->layout_version = circles->layout_version;
+    for (int i = 0; i < sap->count; i++)
+        sap->entries[i].circle = i;
+
+    sap_refresh_boxes(sap, circles);
+    qsort(sap->entries, sap->count, sizeof(SapEntry), sap_compare_entries);
+    sap->swaps = 0;
+}
+
+void sap_refresh_boxes(SweepAndPrune* sap, CircleStore* circles)
+{
+    for (int i = 0; i < sap->count; i++)
+    {
+        SapEntry* entry = &sap->entries[i];
+        int c = entry->circle;
+        float radius = circles->radius[c];
+
+        entry->min_x = circles->x[c] - radius;
+        entry->max_x = circles->x[c] + radius;
+        entry->min_y = circles->y[c] - radius;
+        entry->max_y = circles->y[c] + radius;
+    }
+}
+
+int sap_compare_entries(const void* a, const void* b)
+{
+    float min_a = ((const SapEntry*)a)->min_x;
+    float min_b = ((const SapEntry*)b)->min_x;
+    return (min_a > min_b) - (min_a < min_b);
+}
+
+void sap_destroy(SweepAndPrune* sap)
+{
+    if (sap)
+    {
+        free(sap->entries);
+        free(sap);
+    }
+}
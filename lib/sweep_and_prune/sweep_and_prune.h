@@ -0,0 +1,37 @@
+#ifndef SWEEP_AND_PRUNE_H
+#define SWEEP_AND_PRUNE_H
+
+#include <stdint.h>
+
+#include "../circle/circle.h"
+
+// One circle's bounding box, as of the last sap_update.
+typedef struct
+{
+    float min_x;
+    float max_x;
+    float min_y;
+    float max_y;
+    int circle;
+} SapEntry;
+
+// Sweep and prune keeps every circle's bounding box sorted by its left edge, and keeps the order from one step to the next.
+// Circles only move a few pixels per step, so last step's order is nearly sorted already and an insertion sort
+// fixes it up in close to O(n). Two circles can then only overlap if the second one starts before the first one ends,
+// so the sweep stops looking as soon as it reaches a box that starts past the current one's right edge.
+// There's no cell size to get wrong, which makes it a good fit for clustered scenes that pile into a few grid cells.
+typedef struct
+{
+    int count;
+    int capacity;
+    SapEntry* entries; // sorted by min_x
+    int64_t swaps;     // entries the last sap_update had to move past each other
+    int64_t layout_version; // the store's layout_version the entries were made for
+} SweepAndPrune;
+
+SweepAndPrune* sap_create(int capacity);
+// Refreshes every box from the circles and re-sorts. Starts over from scratch if circles were added, removed or moved around.
+void sap_update(SweepAndPrune* sap, CircleStore* circles);
+void sap_destroy(SweepAndPrune* sap);
+
+#endif
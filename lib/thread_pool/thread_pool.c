@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+#include <stdlib.h>
+
+// private prototypes
+void* pool_worker_main(void* arg);
+void pool_run_tasks(ThreadPool* pool, int worker);
+
+typedef struct
+{
+    ThreadPool* pool;
+    int worker;
+} ThreadPoolWorker;
+
+ThreadPool* pool_create(int thread_count)
+{
+    ThreadPool* pool = malloc(sizeof(ThreadPool));
+
+    if (thread_count < 1)
+        thread_count = 1;
+
+    pool->thread_count = thread_count;
+    pool->generation = 0;
+    pool->workers_busy = 0;
+    pool->stopping = false;
+    pool->task = NULL;
+    pool->context = NULL;
+    pool->task_count = 0;
+    atomic_init(&pool->next_task, 0);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    // worker 0 is whoever calls pool_run, so only start the others
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    for (int i = 1; i < thread_count; i++)
+    {
+        ThreadPoolWorker* worker = malloc(sizeof(ThreadPoolWorker));
+        worker->pool = pool;
+        worker->worker = i;
+        pthread_create(&pool->threads[i], NULL, pool_worker_main, worker);
+    }
+
+    return pool;
+}
+
+void pool_run(ThreadPool* pool, int task_count, ThreadPoolTask task, void* context)
+{
+    if (task_count <= 0)
+        return;
+
+    // no point waking anyone up for a single thread
+    if (pool->thread_count == 1)
+    {
+        for (int i = 0; i < task_count; i++)
+            task(context, i, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+    pool->task_count = task_count;
+    atomic_store(&pool->next_task, 0);
+    pool->workers_busy = pool->thread_count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_run_tasks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->workers_busy > 0)
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Every thread grabs the next unclaimed task until there are none left,
+// so uneven tasks balance themselves out.
+void pool_run_tasks(ThreadPool* pool, int worker)
+{
+    int i;
+    while ((i = atomic_fetch_add(&pool->next_task, 1)) < pool->task_count)
+        pool->task(pool->context, i, worker);
+}
+
+void* pool_worker_main(void* arg)
+{
+    ThreadPoolWorker* self = arg;
+    ThreadPool* pool = self->pool;
+    int seen_generation = 0;
+
+    while (true)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen_generation && !pool->stopping)
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+
+        if (pool->stopping)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_run_tasks(pool, self->worker);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->workers_busy--;
+        if (pool->workers_busy == 0)
+            pthread_cond_signal(&pool->work_done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    free(self);
+    return NULL;
+}
+
+void pool_destroy(ThreadPool* pool)
+{
+    if (pool)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->work_ready);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (int i = 1; i < pool->thread_count; i++)
+            pthread_join(pool->threads[i], NULL);
+
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->work_ready);
+        pthread_cond_destroy(&pool->work_done);
+        free(pool->threads);
+        free(pool);
+    }
+}
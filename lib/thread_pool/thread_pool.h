@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// One unit of work. worker is 0..thread_count-1, handy for per-thread scratch space.
+typedef void (*ThreadPoolTask)(void* context, int task_index, int worker);
+
+// A fixed set of worker threads that run "parallel for" style jobs.
+// The thread calling pool_run joins in as worker 0, so a pool of 4 starts 3 extra threads.
+typedef struct
+{
+    int thread_count;
+    pthread_t* threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    int generation;   // bumped for every job, workers wait for it to change
+    int workers_busy; // workers still running the current job
+    bool stopping;
+
+    // the current job
+    ThreadPoolTask task;
+    void* context;
+    int task_count;
+    atomic_int next_task;
+} ThreadPool;
+
+ThreadPool* pool_create(int thread_count);
+// Runs task(context, i, worker) for every i in [0, task_count) and returns once they've all finished.
+void pool_run(ThreadPool* pool, int task_count, ThreadPoolTask task, void* context);
+void pool_destroy(ThreadPool* pool);
+
+#endif
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 // allegro5 headers
 #include <allegro5/allegro5.h>
@@ -17,66 +19,52 @@
 // lib
 #include "lib/circle/circle.h"
 #include "lib/spatial_grid/spatial_grid.h"
-#include "lib/collision/window_bounds_collider/window_bounds_collider.h"
-#include "lib/collision/circle_collider/circle_collider.h"
-
-
+#include "lib/simulation/simulation.h"
+#include "lib/profiler/profiler.h"
+#include "lib/circle_batch/circle_batch.h"
+#include "lib/render_state/render_state.h"
+
+// Physics runs on its own thread and hands finished ticks to the main thread through a RenderState,
+// so a frame costs the slower of a physics tick and a draw, not both added together.
+// The simulation and its profiler belong to the physics thread once it's started. The main thread only
+// touches the atomics in here and the frames it gets from the RenderState.
+typedef struct
+{
+    Simulation* sim;
+    Profiler* profiler;
+    RenderState* render_state;
+    atomic_bool stop;
+    atomic_llong resize_request; // (width << 32) | height of the newest window size, 0 once it's been applied
+    atomic_int spawn_request;    // circles to add (or remove, when negative) before the next tick
+} PhysicsThread;
 
 // prototypes
-void update_physics(SpatialGrid* grid, Circle** circles, int num_circles, Window bounds);
-void grid_draw_debug(SpatialGrid* grid);
+void* physics_thread_main(void* arg);
+void physics_thread_publish(PhysicsThread* physics, int64_t tick, double tick_time);
+void physics_thread_spawn(PhysicsThread* physics);
+void grid_draw_debug(RenderFrame* frame);
+void profiler_draw_overlay(ProfileFrame* average, ALLEGRO_FONT* font);
 
 // change these for testing
 static int circle_count = 100;
+static int thread_count = 1; // threads used for collision resolution, 1 keeps everything on the main thread
 static int circle_min_radius = 8;
 static int circle_max_radius = 20;
-static int circle_max_speed = 5;
+static int circle_max_speed = 5; // pixels per physics tick
+static int physics_hz = 120;      // physics ticks per second, independent of how often we draw
+static int render_fps = 60;
+static int max_substeps = 8;      // most physics ticks to catch up on per rendered frame
+static int spawn_burst = 1000;    // circles added by = or removed by -
+static float neighbour_skin = 0;  // > 0 reuses each tick's collision pairs until something moves half this far
+static float reorder_threshold = 0.5f; // sort the circles by position when this fraction has drifted apart, 0 never does
+static bool incremental_grid = false;  // keep the grid between ticks and only move the circles that changed cell
+static float restitution = 1.0f;       // speed kept when two circles bounce, below 1 every bounce loses some
+static float damping = 0;              // fraction of its speed every circle loses each tick
+static float sleep_speed = 0;          // > 0 stops colliding circles that have settled below this speed, until something hits them
 static bool draw_grid = false;
-
-int cell_height(Window *window)
-{
-    int target_size = circle_max_radius * 2.5;
-    int best_height = target_size;
-    int best_height_diff = window->height;
-
-    for (int divisor = 1; divisor <= window->height; divisor++)
-    {
-        if (window->height % divisor == 0)
-        {
-            int cell_h = window->height / divisor;
-            int diff = abs(cell_h - target_size);
-            if (diff < best_height_diff)
-            {
-                best_height_diff = diff;
-                best_height = cell_h;
-            }
-        }
-    }
-
-    return best_height;
-}
-int cell_width(Window *window)
-{
-    int target_size = circle_max_radius * 2.5;
-    int best_width = target_size;
-    int best_width_diff = window->width;
-
-    for (int divisor = 1; divisor <= window->width; divisor++)
-    {
-        if (window->width % divisor == 0)
-        {
-            int cell_h = window->height / divisor;
-            int diff = abs(cell_h - target_size);
-            if (diff < best_width_diff)
-            {
-                best_width_diff = diff;
-                best_width = window->width / divisor;
-            }
-        }
-    }
-
-    return best_width;
-}
+static bool draw_filled = true; // false draws outlines
+static bool draw_profiler = true;
+static const char* profiler_csv_path = "profile.csv"; // NULL to skip writing the CSV
 
 int main(void)
 {
@@ -92,7 +80,8 @@ int main(void)
         return 1;
     }
 
-    ALLEGRO_TIMER *timer = al_create_timer(1.0 / 30.0);
+    // the timer only paces rendering. physics catches up to real time on every tick, see below.
+    ALLEGRO_TIMER *timer = al_create_timer(1.0 / render_fps);
     if (!timer)
     {
         printf("couldn't initialize timer\n");
@@ -106,6 +95,8 @@ int main(void)
         return 1;
     }
 
+    // resizable, the simulation world follows the window
+    al_set_new_display_flags(ALLEGRO_RESIZABLE);
     ALLEGRO_DISPLAY *disp = al_create_display(WINDOW_WIDTH, WINDOW_HEIGHT);
     if (!disp)
     {
@@ -142,51 +133,66 @@ int main(void)
 
     al_start_timer(timer);
 
-    Window* window = malloc(sizeof(Window));
-    window->width = WINDOW_WIDTH;
-    window->height = WINDOW_HEIGHT;
-    
-    // create spatial grid
-    SpatialGrid* grid = grid_create(circle_count, window->width, window->height, cell_width(window), cell_height(window));
-
-
-    // create an array of circles
-    Circle *circles[circle_count];
-
-    for (int i = 0; i < circle_count; i++)
+    SimulationSettings settings;
+    settings.circle_count = circle_count;
+    settings.circle_min_radius = circle_min_radius;
+    settings.circle_max_radius = circle_max_radius;
+    settings.circle_max_speed = circle_max_speed;
+    settings.thread_count = thread_count;
+    settings.world_width = WINDOW_WIDTH;
+    settings.world_height = WINDOW_HEIGHT;
+    settings.cell_size = 0; // let the grid pick
+    settings.broad_phase = BROAD_PHASE_GRID; // see broad_phase.h for the others, BROAD_PHASE_AUTO tries them all
+    settings.neighbour_skin = neighbour_skin;
+    settings.seed = 1;
+    settings.packing_fraction = 0; // > 0 fills the window to this fraction instead of using circle_count
+    settings.reorder_threshold = reorder_threshold;
+    settings.incremental_grid = incremental_grid;
+    settings.restitution = restitution;
+    settings.damping = damping;
+    settings.sleep_speed = sleep_speed;
+
+    // creates the grid and places every circle
+    Simulation* sim = simulation_create(settings);
+    if (!sim->placement.complete)
+        printf("only room for %d circles (%.0f%% of the window covered)\n", sim->circles->count, sim->placement.packing * 100.0f);
+
+    // per-tick timings, shown on screen and written to profiler_csv_path. this one belongs to the physics thread.
+    // no hardware counters: they'd count this thread, not the physics thread (bench.out --counters has them).
+    Profiler* profiler = profiler_create(profiler_csv_path, false);
+    if (!profiler)
     {
-        Circle* c = circle_create(i + 1, circle_min_radius, circle_max_radius);
-        // calculate random starting position on the screen
-        float start_x = rand() % (window->width - 100) + 50;
-        float start_y = rand() % (window->height - 100) + 50;
-        
-        // check whether another circle exists to avoid overlap
-        bool position_ok = false;
-        while (!position_ok)
-        {
-            position_ok = true;
-            for (int j = 0; j < i; j++)
-            {
-                Circle* other = circles[j];
-                float dx = other->position[0] - start_x;
-                float dy = other->position[1] - start_y;
-                float distance = sqrtf(dx * dx + dy * dy);
-                if (distance < (c->radius + other->radius))
-                {
-                    position_ok = false;
-                    start_x = rand() % (window->width - 100) + 50;
-                    start_y = rand() % (window->height - 100) + 50;
-                    break;
-                }
-            }
-        }
-        circle_place(c, start_x, start_y, circle_max_speed);
-        circles[i] = c;
-        grid_insert(grid, circles[i]);
+        printf("couldn't open %s for the profiler\n", profiler_csv_path);
+        simulation_destroy(sim);
+        al_destroy_font(font);
+        al_destroy_display(disp);
+        al_destroy_timer(timer);
+        al_destroy_event_queue(queue);
+        return 1;
     }
+    simulation_set_profiler(sim, profiler);
+
+    // and one for the main thread, which only ever times PROFILE_RENDER
+    Profiler* render_profiler = profiler_create(NULL, false);
+
+    // every circle goes to the screen in one primitive call
+    CircleBatch* batch = circle_batch_create();
 
     ALLEGRO_COLOR colour = al_map_rgb(255, 255, 255);
 
+    double physics_dt = 1.0 / physics_hz;
+
+    PhysicsThread physics;
+    physics.sim = sim;
+    physics.profiler = profiler;
+    physics.render_state = render_state_create();
+    atomic_init(&physics.stop, false);
+    atomic_init(&physics.resize_request, 0);
+    atomic_init(&physics.spawn_request, 0);
+
+    pthread_t physics_thread;
+    pthread_create(&physics_thread, NULL, physics_thread_main, &physics);
+
     while (!done)
     {
         al_wait_for_event(queue, &event);
@@ -197,36 +203,73 @@ int main(void)
             redraw = true;
             break;
         case ALLEGRO_EVENT_KEY_DOWN:
+            // = and - add and remove a burst of circles, any other key quits
+            if (event.keyboard.keycode == ALLEGRO_KEY_EQUALS)
+                atomic_fetch_add(&physics.spawn_request, spawn_burst);
+            else if (event.keyboard.keycode == ALLEGRO_KEY_MINUS)
+                atomic_fetch_sub(&physics.spawn_request, spawn_burst);
+            else
+                done = true;
+            break;
         case ALLEGRO_EVENT_DISPLAY_CLOSE:
             done = true;
             break;
+        case ALLEGRO_EVENT_DISPLAY_RESIZE:
+            al_acknowledge_resize(disp);
+            // the physics thread picks this up before its next tick
+            atomic_store(&physics.resize_request, ((long long)al_get_display_width(disp) << 32) | al_get_display_height(disp));
+            redraw = true;
+            break;
         }
 
-        update_physics(grid, circles, circle_count, *window);
+        // nothing to draw until the physics thread has published its first tick
+        RenderFrame* frame = render_state_acquire(physics.render_state);
 
-        if (redraw && al_is_event_queue_empty(queue))
+        if (redraw && frame && al_is_event_queue_empty(queue))
         {
+            profiler_begin(render_profiler, PROFILE_RENDER);
             al_clear_to_color(al_map_rgb(0, 0, 0));
 
             al_draw_text(font, al_map_rgb(255, 255, 255), 320, 0, ALLEGRO_ALIGN_CENTRE, "Bounce!");
 
-            if (draw_grid)
-            {
-                grid_draw_debug(grid);
-            }
+            // only the uniform grid has cells worth drawing
+            if (draw_grid && frame->grid_rows > 0)
+                grid_draw_debug(frame);
+
+            // how far we are past the time the latest tick was due is how far we are between the last two ticks.
+            // drawing that far between their positions keeps motion smooth at any refresh rate.
+            float alpha = (al_get_time() - frame->tick_time) / physics_dt;
+            if (alpha < 0.0f)
+                alpha = 0.0f;
+            if (alpha > 1.0f)
+                alpha = 1.0f;
+            circle_batch_draw(batch, frame->circles, draw_filled, alpha);
 
-            for(int i = 0; i < circle_count; i++)
+            if (draw_profiler)
             {
-                Circle* c = circles[i];
-                circle_draw(c, true);
+                // physics timings come with the frame, the render time is ours
+                ProfileFrame average = frame->profile;
+                average.phase_ns[PROFILE_RENDER] = profiler_average(render_profiler, 60).phase_ns[PROFILE_RENDER];
+                profiler_draw_overlay(&average, font);
             }
 
             al_flip_display();
+            profiler_end(render_profiler, PROFILE_RENDER);
+            profiler_end_frame(render_profiler);
 
             redraw = false;
         }
     }
 
+    atomic_store(&physics.stop, true);
+    pthread_join(physics_thread, NULL);
+
+    circle_batch_destroy(batch);
+    render_state_destroy(physics.render_state);
+    simulation_destroy(sim);
+    profiler_destroy(profiler);
+    profiler_destroy(render_profiler);
+
     al_destroy_font(font);
     al_destroy_display(disp);
     al_destroy_timer(timer);
@@ -235,42 +278,151 @@ int main(void)
     return 0;
 }
 
-void grid_draw_debug(SpatialGrid* grid)
+void* physics_thread_main(void* arg)
+{
+    PhysicsThread* physics = arg;
+
+    // fixed timestep: real time is banked in the accumulator and spent in whole physics ticks,
+    // so simulated time runs at physics_hz no matter how fast (or slowly) the main thread draws.
+    double physics_dt = 1.0 / physics_hz;
+    double accumulator = 0.0;
+    double previous_time = al_get_time();
+    int64_t tick = 0;
+
+    while (!atomic_load(&physics->stop))
+    {
+        long long resize = atomic_exchange(&physics->resize_request, 0);
+        if (resize)
+            simulation_resize_world(physics->sim, (int)(resize >> 32), (int)(resize & 0xffffffff));
+        physics_thread_spawn(physics);
+
+        double now = al_get_time();
+        accumulator += now - previous_time;
+        previous_time = now;
+
+        // several ticks in a row if we fell behind
+        int substeps = 0;
+        while (accumulator >= physics_dt && substeps < max_substeps)
+        {
+            update_physics(physics->sim);
+            profiler_end_frame(physics->profiler);
+            accumulator -= physics_dt;
+            substeps++;
+            tick++;
+        }
+
+        // still behind after max_substeps: physics can't keep up, so let the extra time go
+        // rather than spiralling further and further behind
+        if (accumulator >= physics_dt)
+            accumulator = physics_dt * 0.999;
+
+        if (substeps == 0)
+        {
+            // nothing due yet, sleep until the next tick is
+            al_rest(physics_dt - accumulator);
+            continue;
+        }
+
+        physics_thread_publish(physics, tick, now - accumulator);
+    }
+
+    return NULL;
+}
+
+// Adds or removes whatever the main thread asked for since the last tick.
+void physics_thread_spawn(PhysicsThread* physics)
+{
+    int request = atomic_exchange(&physics->spawn_request, 0);
+    CircleStore* circles = physics->sim->circles;
+
+    // a full window just takes as many as fit
+    if (request > 0)
+        simulation_spawn(physics->sim, request);
+
+    // random circles go, picked by index and removed by handle. the picks are keyed by the step, so the same
+    // request on the same step takes out the same circles.
+    for (int i = 0; i < -request && circles->count > 0; i++)
+    {
+        int index = random_int(circles->seed, (uint64_t)physics->sim->step, RANDOM_STREAM_DESPAWN, i, 0, circles->count - 1);
+        simulation_despawn(physics->sim, circle_handle(circles, index));
+    }
+}
+
+// Copies what the renderer needs into the back frame and hands it over. Only called on the physics thread.
+void physics_thread_publish(PhysicsThread* physics, int64_t tick, double tick_time)
+{
+    RenderFrame* frame = render_state_back(physics->render_state);
+    circle_store_copy_for_drawing(frame->circles, physics->sim->circles);
+    frame->tick = tick;
+    frame->tick_time = tick_time;
+
+    SpatialGrid* grid = broad_phase_current(physics->sim->broad_phase)->grid;
+    frame->grid_rows = grid ? grid->rows : 0;
+    frame->grid_columns = grid ? grid->columns : 0;
+    frame->cell_width = grid ? grid->cell_width : 0;
+    frame->cell_height = grid ? grid->cell_height : 0;
+
+    // averages over about half a second of ticks
+    frame->profile = profiler_average(physics->profiler, 60);
+
+    render_state_publish(physics->render_state);
+}
+
+// The grid itself belongs to the physics thread, so which cells are in use is worked out again from the frame's positions.
+void grid_draw_debug(RenderFrame* frame)
 {
-    for (int row = 0; row < grid->rows; row++) {
-        for (int col = 0; col < grid->columns; col++) {
-            int x = col * grid->cell_width;
-            int y = row * grid->cell_height;
-            ALLEGRO_COLOR color = (grid->cells[row][col].count > 0) 
+    CircleStore* circles = frame->circles;
+    bool* occupied = calloc(frame->grid_rows * frame->grid_columns, sizeof(bool));
+
+    for (int i = 0; i < circles->count; i++)
+    {
+        int row = (int)(circles->y[i] / frame->cell_height);
+        int col = (int)(circles->x[i] / frame->cell_width);
+        row = row < 0 ? 0 : (row >= frame->grid_rows ? frame->grid_rows - 1 : row);
+        col = col < 0 ? 0 : (col >= frame->grid_columns ? frame->grid_columns - 1 : col);
+        occupied[row * frame->grid_columns + col] = true;
+    }
+
+    for (int row = 0; row < frame->grid_rows; row++) {
+        for (int col = 0; col < frame->grid_columns; col++) {
+            int x = col * frame->cell_width;
+            int y = row * frame->cell_height;
+            ALLEGRO_COLOR color = occupied[row * frame->grid_columns + col]
                 ? al_map_rgba(255, 255, 0, 100)  // Yellow if occupied
                 : al_map_rgba(50, 50, 50, 50);    // Dark gray if empty
-            al_draw_rectangle(x, y, x + grid->cell_width, y + grid->cell_height, color, 1);
+            al_draw_rectangle(x, y, x + frame->cell_width, y + frame->cell_height, color, 1);
         }
     }
+
+    free(occupied);
 }
 
 
-void update_physics(SpatialGrid* grid, Circle** circles, int num_circles, Window bounds)
+// Takes averages over a good few ticks, so the numbers are readable.
+void profiler_draw_overlay(ProfileFrame* average, ALLEGRO_FONT* font)
 {
-    grid_clear(grid);
-    
-    // --- 1. UPDATE PHASE (Integrate Movement) ---
-    // Move all circles based on their current velocities.
-    for (int i = 0; i < num_circles; i++)
+    ALLEGRO_COLOR colour = al_map_rgb(255, 255, 255);
+    int line_height = al_get_font_line_height(font);
+    int y = line_height;
+
+    // dim the background so the text is readable over the circles
+    al_draw_filled_rectangle(0, y, 360, y + line_height * (PROFILE_PHASE_COUNT + 6), al_map_rgba(0, 0, 0, 160));
+
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++)
     {
-        circle_move(circles[i]);
-        grid_insert(grid, circles[i]);
+        al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "%-18s %7.3f ms", profiler_phase_names[phase], average->phase_ns[phase] / 1e6);
+        y += line_height;
     }
 
-    // --- 2. RESOLVE PHASE (Handle All Collisions) ---
-    // A. Resolve Circle-Circle Collisions
-    // This resolves overlaps and applies rebound velocities for pairs.
-    ccoll_rebound_velocity(grid);
-    
-
-    // B. Resolve Circle-Wall Collisions
-    // This prevents spheres from getting stuck in the walls.
-    for (int i = 0; i < num_circles; i++)
-        wbcoll_rebound_velocity(circles[i], bounds);
-    
+    al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "pairs tested %lld", (long long)average->candidate_pairs);
+    y += line_height;
+    al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "contacts     %lld", (long long)average->contacts);
+    y += line_height;
+    al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "cells used   %d", average->occupied_cells);
+    y += line_height;
+    al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "max per cell %d", average->max_cell_occupancy);
+    y += line_height;
+    al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "list pairs   %d", average->neighbour_pairs);
+    y += line_height;
+    al_draw_textf(font, colour, 4, y, ALLEGRO_ALIGN_LEFT, "rebuilds     %d / 60 ticks", average->neighbour_rebuilds);
 }
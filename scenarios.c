@@ -0,0 +1,406 @@
+// Scenario suite: runs the physics through a fixed set of named scenes, reports how fast each one goes,
+// and checks on a small copy of each that the broad phase hands the collider every pair that's touching.
+// Exits with 1 if any check fails, so it can gate broad phase changes.
+//
+// ./scenarios.out                       every scenario on the grid
+// ./scenarios.out --scenario cluster --broad-phase quadtree --threads 4
+
+// standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+// lib
+#include "lib/simulation/simulation.h"
+
+// A scene to run. Lengths are in pixels.
+typedef struct
+{
+    const char* name;
+    const char* description;
+    int circle_count;       // ignored when packing_fraction > 0
+    float packing_fraction; // > 0 places circles until they cover this much of the cluster (or the world)
+    int min_radius;
+    int max_radius;
+    int world_width;
+    int world_height;
+    int cluster_size; // > 0 starts every circle inside a square this big in the middle of the world, 0 uses the whole world
+    float restitution; // see SimulationSettings
+    float damping;
+    int steps;
+    int churn_step; // > 0: the world grows by half and the circles double at this step, then half go at twice it
+} Scenario;
+
+static const Scenario scenarios[] = {
+    {"gas", "uniform gas, 15% covered", 10000, 0.0f, 2, 4, 1920, 1080, 0, 1.0f, 0.0f, 500, 0},
+    {"jammed", "random packing close to jamming", 0, 0.45f, 3, 5, 1920, 1080, 0, 1.0f, 0.0f, 500, 0},
+    {"cluster", "one dense clump in an empty world", 0, 0.4f, 2, 4, 4000, 4000, 600, 1.0f, 0.0f, 500, 0},
+    {"mixed", "radii from 1 to 24", 1200, 0.0f, 1, 24, 1920, 1080, 0, 1.0f, 0.0f, 500, 0},
+    {"sparse", "a lot of small circles in a huge world", 50000, 0.0f, 1, 3, 40000, 40000, 0, 1.0f, 0.0f, 200, 0},
+    {"settle", "dense circles losing speed until they stop", 0, 0.45f, 3, 5, 1920, 1080, 0, 0.5f, 0.02f, 1000, 0},
+    {"churn", "circles and world size changing after the broad phase is built", 10000, 0.0f, 2, 4, 1920, 1080, 0, 1.0f, 0.0f, 500, 30},
+};
+#define SCENARIO_COUNT (int)(sizeof(scenarios) / sizeof(scenarios[0]))
+
+// The check is a brute-force O(n^2) search every step, so it runs on a copy of the scenario
+// scaled down (at the same density) to about this many circles.
+#define CHECK_CIRCLES 1500
+#define CHECK_STEPS 100
+
+// What the brute-force search made of one step.
+typedef struct
+{
+    int64_t contacts;   // pairs touching when the collisions started, found by testing every pair
+    int64_t missed;     // of those, pairs the broad phase never handed to the collider
+    int64_t duplicates; // pairs handed to the collider more than once
+} CheckResult;
+
+// prototypes
+void print_usage(const char* program);
+Scenario scenario_scaled(const Scenario* scenario, int circles);
+Simulation* scenario_create(const Scenario* scenario, SimulationSettings settings);
+void scenario_step(const Scenario* scenario, Simulation* sim, int step);
+void scenario_run(const Scenario* scenario, SimulationSettings settings);
+bool scenario_check(const Scenario* scenario, SimulationSettings settings);
+CheckResult check_pairs(CollisionPairLog* log);
+int compare_keys(const void* a, const void* b);
+double seconds_now(void);
+
+int main(int argc, char** argv)
+{
+    SimulationSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.circle_max_speed = 5;
+    settings.thread_count = 1;
+    settings.broad_phase = BROAD_PHASE_GRID;
+    settings.seed = 1;
+    const char* only = NULL;
+    bool check = true;
+
+    static struct option options[] = {
+        {"scenario", required_argument, NULL, 'S'},
+        {"broad-phase", required_argument, NULL, 'b'},
+        {"threads", required_argument, NULL, 't'},
+        {"cell-size", required_argument, NULL, 'c'},
+        {"skin", required_argument, NULL, 'k'},
+        {"seed", required_argument, NULL, 's'},
+        {"reorder", required_argument, NULL, 'o'},
+        {"incremental", no_argument, NULL, 'I'},
+        {"sleep", required_argument, NULL, 'z'},
+        {"no-check", no_argument, NULL, 'x'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "S:b:t:c:k:s:o:Iz:x", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'S': only = optarg; break;
+        case 't': settings.thread_count = atoi(optarg); break;
+        case 'c': settings.cell_size = atoi(optarg); break;
+        case 'k': settings.neighbour_skin = atof(optarg); break;
+        case 's': settings.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'o': settings.reorder_threshold = atof(optarg); break;
+        case 'I': settings.incremental_grid = true; break;
+        case 'z': settings.sleep_speed = atof(optarg); break;
+        case 'x': check = false; break;
+        case 'b':
+            settings.broad_phase = BROAD_PHASE_TYPE_COUNT;
+            for (int type = 0; type < BROAD_PHASE_TYPE_COUNT; type++)
+            {
+                if (strcmp(optarg, broad_phase_names[type]) == 0)
+                    settings.broad_phase = type;
+            }
+            if (settings.broad_phase == BROAD_PHASE_TYPE_COUNT)
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (settings.thread_count < 1)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    printf("broad phase %s, threads %d, seed %u\n", broad_phase_names[settings.broad_phase], settings.thread_count, settings.seed);
+
+    int ran = 0;
+    int failed = 0;
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+    {
+        if (only && strcmp(only, scenarios[i].name) != 0)
+            continue;
+        ran++;
+
+        printf("\n%s: %s\n", scenarios[i].name, scenarios[i].description);
+        fflush(stdout);
+        scenario_run(&scenarios[i], settings);
+        if (check && !scenario_check(&scenarios[i], settings))
+            failed++;
+    }
+
+    if (ran == 0)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (check)
+        printf("\n%d of %d scenarios passed the check\n", ran - failed, ran);
+    return failed > 0 ? 1 : 0;
+}
+
+void print_usage(const char* program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -S, --scenario NAME  only run this one:",
+            program);
+    for (int i = 0; i < SCENARIO_COUNT; i++)
+        fprintf(stderr, " %s", scenarios[i].name);
+    fprintf(stderr,
+            "\n"
+            "  -b, --broad-phase B  grid, hgrid, sap, quadtree, hash or auto, see bench.out --help (grid)\n"
+            "  -t, --threads N      collision threads (1)\n"
+            "  -c, --cell-size N    grid cell size in pixels, 0 picks one automatically (0)\n"
+            "  -k, --skin S         neighbour list skin, only with the grid, 0 is off (0)\n"
+            "  -s, --seed S         random seed (1)\n"
+            "  -o, --reorder F      sort the circles by position when this fraction has drifted apart, 0 is off (0)\n"
+            "  -I, --incremental    keep the grid between steps and only move circles that changed cell\n"
+            "  -z, --sleep S        put settled circles to sleep below S pixels per step, 0 is off (0)\n"
+            "  -x, --no-check       skip the brute-force check, just time the scenarios\n");
+}
+
+// The same scene with about circles circles in it: every length is scaled so the density stays the same.
+// Never smaller than the placement's margins allow.
+Scenario scenario_scaled(const Scenario* scenario, int circles)
+{
+    Scenario scaled = *scenario;
+    float area = (float)scenario->world_width * scenario->world_height;
+    float region = scenario->cluster_size > 0 ? (float)scenario->cluster_size * scenario->cluster_size : area;
+
+    // a packing fraction says nothing about the count, so estimate it from the average circle
+    float mean_radius = (scenario->min_radius + scenario->max_radius) * 0.5f;
+    float expected = scenario->packing_fraction > 0.0f
+                         ? scenario->packing_fraction * region / (3.14159265f * mean_radius * mean_radius)
+                         : (float)scenario->circle_count;
+    if (expected <= circles)
+        return scaled;
+
+    float length = sqrtf(circles / expected);
+    scaled.circle_count = (int)(scenario->circle_count * length * length);
+    scaled.world_width = (int)(scenario->world_width * length);
+    scaled.world_height = (int)(scenario->world_height * length);
+    scaled.cluster_size = (int)(scenario->cluster_size * length);
+
+    int smallest = 4 * scenario->max_radius + 101;
+    if (scaled.world_width < smallest)
+        scaled.world_width = smallest;
+    if (scaled.world_height < smallest)
+        scaled.world_height = smallest;
+    if (scaled.cluster_size > 0 && scaled.cluster_size < smallest)
+        scaled.cluster_size = smallest;
+    return scaled;
+}
+
+// Places the circles in the cluster (or the whole world) and returns the simulation ready to step.
+Simulation* scenario_create(const Scenario* scenario, SimulationSettings settings)
+{
+    settings.circle_count = scenario->circle_count;
+    settings.packing_fraction = scenario->packing_fraction;
+    settings.circle_min_radius = scenario->min_radius;
+    settings.circle_max_radius = scenario->max_radius;
+    settings.restitution = scenario->restitution;
+    settings.damping = scenario->damping;
+    settings.world_width = scenario->cluster_size > 0 ? scenario->cluster_size : scenario->world_width;
+    settings.world_height = scenario->cluster_size > 0 ? scenario->cluster_size : scenario->world_height;
+
+    Simulation* sim = simulation_create(settings);
+    if (scenario->cluster_size <= 0)
+        return sim;
+
+    // placement only knows how to fill a whole world, so fill one the size of the cluster and move it to the middle
+    float offset_x = (scenario->world_width - scenario->cluster_size) * 0.5f;
+    float offset_y = (scenario->world_height - scenario->cluster_size) * 0.5f;
+    CircleStore* circles = sim->circles;
+    for (int i = 0; i < circles->count; i++)
+    {
+        circles->x[i] += offset_x;
+        circles->y[i] += offset_y;
+        circles->previous_x[i] = circles->x[i];
+        circles->previous_y[i] = circles->y[i];
+    }
+    sim->settings.world_width = scenario->world_width;
+    sim->settings.world_height = scenario->world_height;
+    simulation_resize_world(sim, scenario->world_width, scenario->world_height);
+    return sim;
+}
+
+// One step, after whatever the scenario changes on it. The churn is there for the broad phases that keep their
+// structures between steps: they have to be refitted, grown and emptied again after they've been built.
+void scenario_step(const Scenario* scenario, Simulation* sim, int step)
+{
+    if (scenario->churn_step > 0 && step == scenario->churn_step)
+    {
+        // like the app's window being made bigger, and then a burst of spawns to fill it
+        sim->settings.world_width = sim->bounds.width * 3 / 2;
+        sim->settings.world_height = sim->bounds.height * 3 / 2;
+        simulation_resize_world(sim, sim->settings.world_width, sim->settings.world_height);
+        simulation_spawn(sim, sim->circles->count);
+    }
+    else if (scenario->churn_step > 0 && step == scenario->churn_step * 2)
+    {
+        // more than a quarter gone, so update_physics refits by itself
+        CircleStore* circles = sim->circles;
+        int remove = circles->count / 2;
+        for (int i = 0; i < remove; i++)
+        {
+            int index = random_int(circles->seed, (uint64_t)sim->step, RANDOM_STREAM_DESPAWN, i, 0, circles->count - 1);
+            simulation_despawn(sim, circle_handle(circles, index));
+        }
+    }
+
+    update_physics(sim);
+}
+
+void scenario_run(const Scenario* scenario, SimulationSettings settings)
+{
+    double setup_start = seconds_now();
+    Simulation* sim = scenario_create(scenario, settings);
+    double setup_time = seconds_now() - setup_start;
+
+    int64_t pairs = 0;
+    int64_t contacts = 0;
+    double start = seconds_now();
+    for (int step = 0; step < scenario->steps; step++)
+    {
+        scenario_step(scenario, sim, step);
+        pairs += sim->last_stats.candidate_pairs;
+        contacts += sim->last_stats.contacts;
+    }
+    double elapsed = seconds_now() - start;
+
+    double circle_steps = (double)scenario->steps * sim->circles->count;
+    printf("  circles         %10d (radius %d-%d, world %dx%d, %.1f%% covered)\n", sim->circles->count,
+           scenario->min_radius, scenario->max_radius, scenario->world_width, scenario->world_height,
+           sim->placement.packing * 100.0f);
+    printf("  setup           %10.3f s\n", setup_time);
+    printf("  steps/sec       %10.1f (%d steps)\n", scenario->steps / elapsed, scenario->steps);
+    printf("  ns/circle-step  %10.2f\n", elapsed * 1e9 / circle_steps);
+    printf("  pairs/step      %10lld\n", (long long)(pairs / scenario->steps));
+    printf("  contacts/step   %10lld\n", (long long)(contacts / scenario->steps));
+    if (sim->sleep)
+        printf("  asleep          %10d at the end\n", sim->sleep->asleep);
+    if (settings.broad_phase == BROAD_PHASE_AUTO)
+        printf("  auto chose      %10s\n", broad_phase_names[broad_phase_current(sim->broad_phase)->type]);
+    fflush(stdout);
+
+    simulation_destroy(sim);
+}
+
+// Steps a small copy of the scenario and, every step, compares the pairs the collider was handed against
+// every pair that was touching when the collisions started. The broad phase may hand over as many extra pairs
+// as it likes, but it has to include every touching pair, and only once.
+bool scenario_check(const Scenario* scenario, SimulationSettings settings)
+{
+    Scenario small = scenario_scaled(scenario, CHECK_CIRCLES);
+    Simulation* sim = scenario_create(&small, settings);
+    CollisionPairLog* log = ccoll_pair_log_create();
+    broad_phase_set_pair_log(sim->broad_phase, log);
+
+    CheckResult total = {0, 0, 0};
+    int first_bad_step = -1;
+    for (int step = 0; step < CHECK_STEPS; step++)
+    {
+        scenario_step(&small, sim, step);
+
+        CheckResult result = check_pairs(log);
+        total.contacts += result.contacts;
+        total.missed += result.missed;
+        total.duplicates += result.duplicates;
+        if (first_bad_step < 0 && (result.missed > 0 || result.duplicates > 0))
+            first_bad_step = step;
+    }
+
+    bool passed = total.missed == 0 && total.duplicates == 0;
+    printf("  check           %10s (%d circles, %d steps, %lld contacts", passed ? "ok" : "FAILED", sim->circles->count,
+           CHECK_STEPS, (long long)total.contacts);
+    if (!passed)
+        printf(", %lld missed, %lld duplicated, first on step %d", (long long)total.missed, (long long)total.duplicates, first_bad_step);
+    printf(")\n");
+
+    broad_phase_set_pair_log(sim->broad_phase, NULL);
+    ccoll_pair_log_destroy(log);
+    simulation_destroy(sim);
+    return passed;
+}
+
+// Both searches use the collider's own test (squared distance against squared radius sum, in floats),
+// so any difference is down to the broad phase and not rounding.
+CheckResult check_pairs(CollisionPairLog* log)
+{
+    CheckResult result = {0, 0, 0};
+    int64_t count = log->circle_count;
+
+    // one key per unordered pair, sorted so duplicates sit together and lookups can bisect
+    int64_t* keys = malloc((log->pair_count + 1) * sizeof(int64_t));
+    for (int pair = 0; pair < log->pair_count; pair++)
+    {
+        int64_t a = log->first[pair];
+        int64_t b = log->second[pair];
+        keys[pair] = a < b ? a * count + b : b * count + a;
+    }
+    qsort(keys, log->pair_count, sizeof(int64_t), compare_keys);
+
+    for (int pair = 1; pair < log->pair_count; pair++)
+    {
+        if (keys[pair] == keys[pair - 1])
+            result.duplicates++;
+    }
+
+    for (int64_t i = 0; i < count; i++)
+    {
+        for (int64_t j = i + 1; j < count; j++)
+        {
+            float dx = log->x[j] - log->x[i];
+            float dy = log->y[j] - log->y[i];
+            float radius_sum = log->radius[i] + log->radius[j];
+            if (dx * dx + dy * dy >= radius_sum * radius_sum || (log->asleep[i] && log->asleep[j]))
+                continue;
+
+            result.contacts++;
+            int64_t key = i * count + j;
+            if (!bsearch(&key, keys, log->pair_count, sizeof(int64_t), compare_keys))
+                result.missed++;
+        }
+    }
+
+    free(keys);
+    return result;
+}
+
+int compare_keys(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+double seconds_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}